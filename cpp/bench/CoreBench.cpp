@@ -0,0 +1,239 @@
+// Microbenchmarks of the core engine. "make bench" writes results into
+// bench.json, results of two releases can be compared by compare.py script
+// of Google benchmark. Hardware counters per iteration are reported next to
+// the timings when perf_event_open is permitted.
+
+#include <hyperon/hyperon.h>
+#include <hyperon/common/common.h>
+
+#include <benchmark/benchmark.h>
+
+#include "PerfCounters.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Counts hardware events of the benchmark loop, should be created right
+// before the loop
+class PerfRegion {
+public:
+
+    PerfRegion(benchmark::State& state) : state(state) {
+        counters().start();
+    }
+
+    ~PerfRegion() {
+        PerfCounters& perf = counters();
+        perf.stop();
+        for (size_t i = 0; i < PerfCounters::EVENTS; ++i) {
+            PerfCounters::Event event = static_cast<PerfCounters::Event>(i);
+            if (perf.available(event)) {
+                state.counters[PerfCounters::name(event)] = benchmark::Counter(
+                        perf.value(event), benchmark::Counter::kAvgIterations);
+            }
+        }
+    }
+
+private:
+
+    static PerfCounters& counters() {
+        static PerfCounters perf;
+        static bool reported = false;
+        if (!reported && !perf.error().empty()) {
+            std::cerr << "Hardware counters are not available: " << perf.error() << std::endl;
+        }
+        reported = true;
+        return perf;
+    }
+
+    benchmark::State& state;
+};
+
+static AtomPtr const ISA = S("isa");
+static AtomPtr const FROG = S("frog");
+static AtomPtr const LAMP = S("lamp");
+
+// Knowledge base of (isa objN lamp) and (isa objN frog) facts, every tenth
+// object is a frog
+static void add_facts(GroundingSpace& kb, int64_t size) {
+    for (int64_t i = 0; i < size; ++i) {
+        kb.add_atom(E({ ISA, S("obj" + std::to_string(i)), i % 10 ? LAMP : FROG }));
+    }
+}
+
+// Atomese has no tokens for true and false, so rules of if are built here
+static void add_if_definition(GroundingSpace& kb) {
+    kb.add_atom(E({ S("="), E({ S("if"), TRUE, V("then"), V("else") }), V("then") }));
+    kb.add_atom(E({ S("="), E({ S("if"), FALSE, V("then"), V("else") }), V("else") }));
+}
+
+static void add_fact_definition(GroundingSpace& kb) {
+    add_if_definition(kb);
+    Atomese().parse("(= (fact $n) (if (== 0 $n) 1 (* (fact (- $n 1)) $n)))", kb);
+}
+
+static void add_fib_definition(GroundingSpace& kb) {
+    add_if_definition(kb);
+    Atomese().parse("(= (fib $n) (if (== 0 $n) 0 (if (== 1 $n) 1"
+            " (+ (fib (- $n 1)) (fib (- $n 2))))))", kb);
+}
+
+static void check(AtomPtr const& result, AtomPtr const& expected) {
+    if (*result != *expected) {
+        throw std::runtime_error("Unexpected result: " + result->to_string());
+    }
+}
+
+// Pattern with the head looked up by index
+static void BM_MatchIndexed(benchmark::State& state) {
+    GroundingSpace kb;
+    add_facts(kb, state.range(0));
+    AtomPtr pattern = E({ ISA, V("x"), FROG });
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kb.match(pattern));
+    }
+    state.SetItemsProcessed(state.iterations() * kb.size());
+}
+BENCHMARK(BM_MatchIndexed)->RangeMultiplier(10)->Range(100, 100000);
+
+// Pattern with variable head which is matched with each atom
+static void BM_MatchScan(benchmark::State& state) {
+    GroundingSpace kb;
+    add_facts(kb, state.range(0));
+    AtomPtr pattern = E({ V("p"), V("x"), FROG });
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kb.match(pattern));
+    }
+    state.SetItemsProcessed(state.iterations() * kb.size());
+}
+BENCHMARK(BM_MatchScan)->RangeMultiplier(10)->Range(100, 100000);
+
+static void BM_MatchConjunction(benchmark::State& state) {
+    GroundingSpace kb;
+    add_facts(kb, state.range(0));
+    for (int64_t i = 0; i < state.range(0); i += 10) {
+        kb.add_atom(E({ S("color"), S("obj" + std::to_string(i)), S("green") }));
+    }
+    std::vector<AtomPtr> clauses{ E({ ISA, V("x"), FROG }),
+        E({ S("color"), V("x"), V("c") }) };
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kb.match(clauses));
+    }
+    state.SetItemsProcessed(state.iterations() * kb.size());
+}
+BENCHMARK(BM_MatchConjunction)->RangeMultiplier(10)->Range(100, 100000);
+
+// Function call unified with one of the rules (= (fN $x) ...)
+static void BM_Unify(benchmark::State& state) {
+    GroundingSpace kb;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        kb.add_atom(E({ S("="), E({ S("f" + std::to_string(i)), V("x") }),
+                    E({ S("g"), V("x"), S("a") }) }));
+    }
+    if (state.range(1)) {
+        kb.compile_rules();
+    }
+    AtomPtr call = E({ S("="), E({ S("f0"), S("b") }), V("r") });
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kb.unify(call));
+    }
+}
+BENCHMARK(BM_Unify)->ArgNames({ "rules", "compiled" })
+    ->ArgsProduct({ { 10, 1000, 100000 }, { 0, 1 } });
+
+static void BM_InterpretFactorial(benchmark::State& state) {
+    GroundingSpace kb;
+    add_fact_definition(kb);
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        GroundingSpace target{ E({ S("fact"), Int(state.range(0)) }) };
+        check(interpret_until_result(target, kb), Int(state.range(0) == 5 ? 120 : 3628800));
+    }
+}
+BENCHMARK(BM_InterpretFactorial)->Arg(5)->Arg(10);
+
+static void BM_InterpretFib(benchmark::State& state) {
+    GroundingSpace kb;
+    add_fib_definition(kb);
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        GroundingSpace target{ E({ S("fib"), Int(state.range(0)) }) };
+        check(interpret_until_result(target, kb), Int(state.range(0) == 5 ? 5 : 55));
+    }
+}
+BENCHMARK(BM_InterpretFib)->Arg(5)->Arg(10);
+
+static void BM_InterpreterFib(benchmark::State& state) {
+    GroundingSpace kb;
+    add_fib_definition(kb);
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        Interpreter interpreter(kb);
+        interpreter.add_atom(E({ S("fib"), Int(state.range(0)) }));
+        check(interpret_until_result(interpreter), Int(state.range(0) == 5 ? 5 : 55));
+    }
+}
+BENCHMARK(BM_InterpreterFib)->Arg(5)->Arg(10);
+
+// Program text of the given number of facts and rules
+static std::string make_program(int64_t atoms) {
+    std::string program;
+    for (int64_t i = 0; i < atoms; ++i) {
+        std::string n = std::to_string(i);
+        program += i % 2 ? "(isa obj" + n + " lamp)\n"
+            : "(= (weight obj" + n + ") (+ " + n + " (* 2 $x)))\n";
+    }
+    return program;
+}
+
+static void BM_TextSpaceParse(benchmark::State& state) {
+    std::string program = make_program(state.range(0));
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        TextSpace text;
+        text.register_token("\\d+", [](std::string token) -> AtomPtr {
+                    return Int(std::stoi(token));
+                });
+        text.add_string(program);
+        GroundingSpace kb;
+        kb.add_from_space(text);
+        benchmark::DoNotOptimize(kb.size());
+    }
+    state.SetBytesProcessed(state.iterations() * program.size());
+}
+BENCHMARK(BM_TextSpaceParse)->Arg(1000);
+
+static void BM_AtomeseParse(benchmark::State& state) {
+    std::string program = make_program(state.range(0));
+    Atomese atomese;
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        GroundingSpace kb;
+        atomese.parse(program, kb);
+        benchmark::DoNotOptimize(kb.size());
+    }
+    state.SetBytesProcessed(state.iterations() * program.size());
+}
+BENCHMARK(BM_AtomeseParse)->Arg(10)->Arg(1000);
+
+static void BM_GroundedArithmetic(benchmark::State& state) {
+    std::vector<AtomPtr> args{ ADD, Int(2), Int(3) };
+    std::vector<AtomPtr> results;
+    AtomVectorSink sink(results);
+    PerfRegion perf(state);
+    for (auto _ : state) {
+        results.clear();
+        ADD->execute(AtomSpan(args), sink);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GroundedArithmetic);
+
+BENCHMARK_MAIN();
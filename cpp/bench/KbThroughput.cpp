@@ -0,0 +1,93 @@
+// Measures throughput of queries to a single knowledge base shared by
+// threads. Usage: kb_throughput [max_threads] [seconds_per_run]
+
+#include <hyperon/hyperon.h>
+#include <hyperon/common/common.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+static void load_kb(GroundingSpace& kb) {
+    Atomese atomese;
+    atomese.parse("(= (bin) 0) (= (bin) 1) (= (pair) (:: (bin) (bin)))", kb);
+    atomese.parse("(= (sum (:: $a $b)) (+ $a $b))", kb);
+    atomese.parse("(= (len nil) 0) (= (len (:: $x $xs)) (+ 1 (len $xs)))", kb);
+    atomese.parse("(= (if True $then $else) $then)", kb);
+    atomese.parse("(= (if False $then $else) $else)", kb);
+    kb.add_atom(E({ S("="), E({ S("fact"), V("n") }),
+                E({ S("if"), E({ EQ, Int(0), V("n") }), Int(1),
+                    E({ MUL, E({ S("fact"), E({ SUB, V("n"), Int(1) }) }),
+                        V("n") }) }) }));
+    for (int i = 0; i < 1000; ++i) {
+        kb.add_atom(E({ S("isa"), S("obj" + std::to_string(i)),
+                    S(i % 10 ? "lamp" : "frog") }));
+    }
+}
+
+// Runs one query: interprets a few programs and matches the data
+static void query(GroundingSpace const& kb, GroundingSpace const& program) {
+    GroundingSpace target(program.get_content());
+    while (*interpret_until_result(target, kb) != *S("eos"));
+    kb.count(E({ S("isa"), V("x"), S("frog") }));
+}
+
+static double run(GroundingSpace const& kb, GroundingSpace const& program,
+        size_t threads, double seconds) {
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> queries{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&]() -> void {
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                query(kb, program);
+                ++count;
+            }
+            queries += count;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return queries / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t max_threads = argc > 1 ? std::atoi(argv[1])
+        : std::max(1u, std::thread::hardware_concurrency());
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+
+    GroundingSpace kb;
+    load_kb(kb);
+    kb.compile_rules();
+    GroundingSpace program;
+    Atomese().parse("(sum (pair)) (len (:: 1 (:: 2 (:: 3 nil))))", program);
+    program.add_atom(E({ S("fact"), Int(8) }));
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    double single = 0;
+    for (size_t threads : thread_counts) {
+        double throughput = run(kb, program, threads, seconds);
+        if (threads == 1) {
+            single = throughput;
+        }
+        std::cout << "threads: " << std::setw(3) << threads
+            << " queries/s: " << std::setw(10) << std::fixed << std::setprecision(1) << throughput
+            << " speedup: " << std::setprecision(2) << throughput / single << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "PerfCounters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+static int open_counter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters() {
+    static std::pair<uint32_t, uint64_t> const events[EVENTS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    for (size_t i = 0; i < EVENTS; ++i) {
+        fds[i] = open_counter(events[i].first, events[i].second);
+        if (fds[i] < 0 && open_error.empty()) {
+            open_error = std::string(name(static_cast<Event>(i))) + ": " + std::strerror(errno);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+char const* PerfCounters::name(Event event) {
+    static char const* names[] = { "cycles", "instructions", "l1d_misses",
+        "llc_misses", "branch_misses" };
+    return names[event];
+}
+
+bool PerfCounters::read_counter(int fd, Reading& reading) {
+    return read(fd, reading.data(), sizeof(reading)) == sizeof(reading);
+}
+
+void PerfCounters::start() {
+    for (size_t i = 0; i < EVENTS; ++i) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            if (!read_counter(fds[i], base[i])) {
+                base[i] = {};
+            }
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+int64_t PerfCounters::value(Event event) const {
+    if (fds[event] < 0) {
+        return -1;
+    }
+    Reading data;
+    if (!read_counter(fds[event], data)) {
+        return -1;
+    }
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] -= base[event][i];
+    }
+    if (data[2] == 0) {
+        return 0;
+    }
+    return data[2] < data[1] ? static_cast<int64_t>(double(data[0]) * data[1] / data[2]) : data[0];
+}
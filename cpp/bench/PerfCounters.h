@@ -0,0 +1,56 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware counters of the calling process read by Linux perf_event_open.
+// Threads started after the counters are opened are counted too, their
+// counts are added when they exit. Counters which cannot be opened (not
+// supported by CPU or virtual machine, forbidden by perf_event_paranoid)
+// are not reported.
+class PerfCounters {
+public:
+
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        EVENTS
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(PerfCounters const&) = delete;
+
+    bool available(Event event) const { return fds[event] >= 0; }
+    // Reason why the first counter which is not available cannot be opened
+    std::string const& error() const { return open_error; }
+    static char const* name(Event event);
+
+    // Starts counting from zero. Counts of exited threads are not cleared
+    // by the kernel, so they are read here and subtracted by value().
+    void start();
+    void stop();
+    // Value counted between start() and stop(), it is scaled when the
+    // counter was multiplexed with other counters; -1 when counter is not
+    // available
+    int64_t value(Event event) const;
+
+private:
+
+    // value, time enabled, time running
+    using Reading = std::array<uint64_t, 3>;
+
+    static bool read_counter(int fd, Reading& reading);
+
+    std::array<int, EVENTS> fds;
+    // Readings at start()
+    std::array<Reading, EVENTS> base{};
+    std::string open_error;
+};
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,244 @@
+// Runs the generated workloads at several sizes and thread counts and
+// writes CSV with throughput, p50 and p99 latency of queries and peak
+// resident set size, one line per run. Lines of one workload and thread
+// count make a scaling curve by size. Each workload size is run in a
+// separate process, so peak RSS is measured for this size only. Hardware
+// counters per query are written when perf_event_open is permitted, their
+// columns are left empty otherwise.
+//
+// Usage: scaling_bench [options]
+//   --workloads home_match,crafting,...  all workloads by default
+//   --sizes 100,1000,10000
+//   --threads 1,2,4
+//   --seconds 1      duration of each run
+//   --seed 1
+
+#include "Workload.h"
+#include "PerfCounters.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+struct Options {
+    std::vector<std::string> workloads = workload_names();
+    std::vector<size_t> sizes{ 100, 1000, 10000 };
+    std::vector<size_t> threads{ 1, 2, 4 };
+    double seconds = 1.0;
+    unsigned seed = 1;
+};
+
+struct RunResult {
+    double throughput;
+    double p50;
+    double p99;
+    size_t queries;
+    size_t results;
+    std::array<int64_t, PerfCounters::EVENTS> counters;
+};
+
+static std::vector<std::string> split(char const* list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static std::vector<size_t> split_numbers(char const* list) {
+    std::vector<size_t> numbers;
+    for (auto const& item : split(list)) {
+        numbers.push_back(std::stoul(item));
+    }
+    return numbers;
+}
+
+// Peak resident set size of the process in kilobytes
+static long peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Counts latencies in buckets of less than 1% width instead of keeping
+// them, so memory of the run doesn't grow with its duration and peak RSS
+// is used by the knowledge base and the engine only
+class LatencyHistogram {
+public:
+    LatencyHistogram() : buckets(BUCKETS) { }
+
+    void add(uint64_t nanoseconds) {
+        ++buckets[bucket(nanoseconds)];
+        ++total;
+    }
+    void merge(LatencyHistogram const& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        total += other.total;
+    }
+    size_t count() const { return total; }
+    // Returns the lower bound of the bucket in microseconds
+    double percentile(double p) const {
+        size_t rank = std::min(total - 1, static_cast<size_t>(p * total));
+        size_t counted = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            counted += buckets[i];
+            if (counted > rank) {
+                return lower_bound(i) / 1000.0;
+            }
+        }
+        return 0;
+    }
+
+private:
+    // Values below SUB_BUCKETS have own buckets, each next power of two is
+    // split into SUB_BUCKETS buckets
+    static constexpr size_t SUB_BUCKETS = 128;
+    static constexpr size_t BUCKETS = 64 * SUB_BUCKETS;
+
+    static size_t bucket(uint64_t value) {
+        size_t shift = 0;
+        while ((value >> shift) >= 2 * SUB_BUCKETS) {
+            ++shift;
+        }
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+    static uint64_t lower_bound(size_t bucket) {
+        if (bucket < 2 * SUB_BUCKETS) {
+            return bucket;
+        }
+        size_t shift = bucket / SUB_BUCKETS - 1;
+        return uint64_t(bucket - shift * SUB_BUCKETS) << shift;
+    }
+
+    std::vector<uint64_t> buckets;
+    size_t total = 0;
+};
+
+static RunResult run(Workload const& workload, size_t threads, double seconds,
+        unsigned seed, PerfCounters& perf) {
+    using clock = std::chrono::steady_clock;
+    std::atomic<bool> stop{false};
+    std::vector<LatencyHistogram> latencies(threads);
+    std::vector<size_t> results(threads);
+    std::vector<std::thread> workers;
+    perf.start();
+    auto start = clock::now();
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() -> void {
+            std::mt19937 random(seed + i);
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto query_start = clock::now();
+                results[i] += workload.query(workload.kb, random);
+                latencies[i].add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            clock::now() - query_start).count());
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    perf.stop();
+
+    LatencyHistogram all;
+    size_t total = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        all.merge(latencies[i]);
+        total += results[i];
+    }
+    RunResult result{ all.count() / elapsed.count(), 0, 0, all.count(), total, {} };
+    if (all.count()) {
+        result.p50 = all.percentile(0.5);
+        result.p99 = all.percentile(0.99);
+    }
+    for (size_t i = 0; i < PerfCounters::EVENTS; ++i) {
+        result.counters[i] = perf.value(static_cast<PerfCounters::Event>(i));
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--workloads")) {
+            options.workloads = split(argv[i + 1]);
+        } else if (!std::strcmp(argv[i], "--sizes")) {
+            options.sizes = split_numbers(argv[i + 1]);
+        } else if (!std::strcmp(argv[i], "--threads")) {
+            options.threads = split_numbers(argv[i + 1]);
+        } else if (!std::strcmp(argv[i], "--seconds")) {
+            options.seconds = std::atof(argv[i + 1]);
+        } else if (!std::strcmp(argv[i], "--seed")) {
+            options.seed = std::atoi(argv[i + 1]);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    {
+        PerfCounters perf;
+        if (!perf.error().empty()) {
+            std::cerr << "Hardware counters are not available: " << perf.error() << std::endl;
+        }
+    }
+
+    std::cout << "workload,size,threads,queries_per_s,p50_us,p99_us,results_per_query,peak_rss_kb";
+    for (size_t i = 0; i < PerfCounters::EVENTS; ++i) {
+        std::cout << "," << PerfCounters::name(static_cast<PerfCounters::Event>(i)) << "_per_query";
+    }
+    std::cout << std::endl;
+    for (auto const& name : options.workloads) {
+        for (size_t size : options.sizes) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::cerr << "Could not start process: " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            if (pid > 0) {
+                int status;
+                waitpid(pid, &status, 0);
+                if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+                    std::cerr << "Workload " << name << " of size " << size << " failed" << std::endl;
+                    return 1;
+                }
+                continue;
+            }
+            std::unique_ptr<Workload> workload = make_workload(name, size, options.seed);
+            PerfCounters perf;
+            for (size_t threads : options.threads) {
+                RunResult result = run(*workload, threads, options.seconds, options.seed, perf);
+                std::cout << name << "," << size << "," << threads << "," <<
+                    std::fixed << std::setprecision(1) << result.throughput << "," <<
+                    result.p50 << "," << result.p99 << "," <<
+                    (result.queries ? double(result.results) / result.queries : 0) << "," <<
+                    peak_rss();
+                for (int64_t count : result.counters) {
+                    std::cout << ",";
+                    if (count >= 0 && result.queries) {
+                        std::cout << double(count) / result.queries;
+                    }
+                }
+                std::cout << std::endl;
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
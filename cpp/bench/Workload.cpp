@@ -0,0 +1,178 @@
+#include "Workload.h"
+
+#include <hyperon/common/common.h>
+
+#include <stdexcept>
+
+static AtomPtr const EOS = S("eos");
+
+static size_t random_index(std::mt19937& random, size_t size) {
+    return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+}
+
+static AtomPtr symbol(std::string const& prefix, size_t index) {
+    return S(prefix + std::to_string(index));
+}
+
+// Interprets expression until all results are returned as
+// interpret_and_print_results() of the Python tests does
+static size_t interpret_all(GroundingSpace const& kb, AtomPtr const& expr) {
+    GroundingSpace target{ expr };
+    size_t results = 0;
+    while (*interpret_until_result(target, kb) != *EOS) {
+        ++results;
+    }
+    return results;
+}
+
+static void add_if_definition(GroundingSpace& kb) {
+    kb.add_atom(E({ S("="), E({ S("if"), TRUE, V("then"), V("else") }), V("then") }));
+    kb.add_atom(E({ S("="), E({ S("if"), FALSE, V("then"), V("else") }), V("else") }));
+}
+
+// Smart home: devices of different types placed in rooms, lamps are turned
+// on by room
+
+static void add_devices(GroundingSpace& kb, size_t devices, size_t rooms,
+        std::mt19937& random) {
+    static AtomPtr const types[] = { S("lamp"), S("lamp"), S("kettle"), S("heater") };
+    for (size_t i = 0; i < devices; ++i) {
+        AtomPtr device = symbol("dev", i);
+        AtomPtr type = types[random_index(random, 4)];
+        AtomPtr room = symbol("room", random_index(random, rooms));
+        kb.add_atom(E({ S("isa"), device, type }));
+        kb.add_atom(E({ S("in"), device, room }));
+        if (type == types[0]) {
+            kb.add_atom(E({ S("="), E({ S("room-lamp"), room, device }), TRUE }));
+        }
+    }
+}
+
+static std::unique_ptr<Workload> home_match(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t rooms = std::max<size_t>(1, size / 10);
+    add_devices(workload->kb, size, rooms, random);
+    workload->query = [rooms](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return kb.match({ E({ S("isa"), V("x"), S("lamp") }),
+                E({ S("in"), V("x"), symbol("room", random_index(random, rooms)) }) }).size();
+    };
+    return workload;
+}
+
+static std::unique_ptr<Workload> home_rules(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t rooms = std::max<size_t>(1, size / 10);
+    add_if_definition(workload->kb);
+    workload->kb.add_atom(E({ S("="), E({ S("turn-on-lamps"), V("room") }),
+                E({ S("if"), E({ S("room-lamp"), V("room"), V("x") }),
+                    E({ S("turn-on"), V("x") }), S("nop") }) }));
+    add_devices(workload->kb, size, rooms, random);
+    workload->query = [rooms](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return interpret_all(kb, E({ S("turn-on-lamps"),
+                    symbol("room", random_index(random, rooms)) }));
+    };
+    return workload;
+}
+
+// Minecraft: items of the first tier are mined, items of the next tiers are
+// crafted from two items of the previous tier
+
+static std::unique_ptr<Workload> crafting(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t tier = std::max<size_t>(1, size / 3);
+    for (size_t i = 0; i < 3 * tier; ++i) {
+        AtomPtr item = symbol("item", i);
+        AtomPtr recipe;
+        if (i < tier) {
+            recipe = E({ S("mine"), symbol("ore", i), S("hand") });
+        } else {
+            size_t previous = (i / tier - 1) * tier;
+            recipe = E({ S("craft"), item, S("inventory"),
+                    E({ symbol("item", previous + random_index(random, tier)) }),
+                    E({ symbol("item", previous + random_index(random, tier)) }) });
+        }
+        workload->kb.add_atom(E({ S("="), E({ item }), recipe }));
+    }
+    workload->query = [tier](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return interpret_all(kb, E({ symbol("item", 2 * tier + random_index(random, tier)) }));
+    };
+    return workload;
+}
+
+// Semantic triples (predicate subject object) as in the examples of match
+
+static size_t constexpr PREDICATES = 16;
+
+static size_t add_triples(GroundingSpace& kb, size_t size, std::mt19937& random) {
+    size_t entities = std::max<size_t>(10, size / 4);
+    for (size_t i = 0; i < size; ++i) {
+        kb.add_atom(E({ symbol("pred", random_index(random, PREDICATES)),
+                    symbol("ent", random_index(random, entities)),
+                    symbol("ent", random_index(random, entities)) }));
+    }
+    return entities;
+}
+
+static std::unique_ptr<Workload> triples_lookup(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t entities = add_triples(workload->kb, size, random);
+    workload->query = [entities](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return kb.match(E({ symbol("pred", random_index(random, PREDICATES)),
+                    symbol("ent", random_index(random, entities)), V("o") })).size();
+    };
+    return workload;
+}
+
+static std::unique_ptr<Workload> triples_scan(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t entities = add_triples(workload->kb, size, random);
+    workload->query = [entities](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return kb.match(E({ V("p"), symbol("ent", random_index(random, entities)),
+                    V("o") })).size();
+    };
+    return workload;
+}
+
+static std::unique_ptr<Workload> triples_join(size_t size, std::mt19937& random) {
+    std::unique_ptr<Workload> workload(new Workload());
+    size_t entities = add_triples(workload->kb, size, random);
+    workload->query = [entities](GroundingSpace const& kb, std::mt19937& random) -> size_t {
+        return kb.match({ E({ symbol("pred", random_index(random, PREDICATES)),
+                    symbol("ent", random_index(random, entities)), V("x") }),
+                E({ symbol("pred", random_index(random, PREDICATES)), V("x"), V("y") }) }).size();
+    };
+    return workload;
+}
+
+using WorkloadFactory = std::unique_ptr<Workload> (*)(size_t size, std::mt19937& random);
+
+static std::vector<std::pair<std::string, WorkloadFactory>> const WORKLOADS{
+    { "home_match", home_match },
+    { "home_rules", home_rules },
+    { "crafting", crafting },
+    { "triples_lookup", triples_lookup },
+    { "triples_scan", triples_scan },
+    { "triples_join", triples_join },
+};
+
+std::vector<std::string> const& workload_names() {
+    static std::vector<std::string> const names = []() {
+        std::vector<std::string> names;
+        for (auto const& workload : WORKLOADS) {
+            names.push_back(workload.first);
+        }
+        return names;
+    }();
+    return names;
+}
+
+std::unique_ptr<Workload> make_workload(std::string const& name, size_t size,
+        unsigned seed) {
+    std::mt19937 random(seed);
+    for (auto const& workload : WORKLOADS) {
+        if (workload.first == name) {
+            return workload.second(size, random);
+        }
+    }
+    throw std::runtime_error("Unknown workload: " + name);
+}
@@ -0,0 +1,30 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <hyperon/GroundingSpace.h>
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Knowledge base and queries which scale up one of the scenarios of the
+// Python tests. Knowledge base is generated by the seeded random generator,
+// so the same seed gives the same workload.
+struct Workload {
+    GroundingSpace kb;
+    // Runs one query chosen by the random generator against kb and returns
+    // the number of results, can be called from many threads at once
+    std::function<size_t(GroundingSpace const& kb, std::mt19937& random)> query;
+};
+
+// Scenarios, size is the number of:
+// - home_match, home_rules: devices placed in size/10 rooms
+// - crafting: recipes of three tiers
+// - triples_lookup, triples_scan, triples_join: triples
+std::vector<std::string> const& workload_names();
+std::unique_ptr<Workload> make_workload(std::string const& name, size_t size,
+        unsigned seed);
+
+#endif /* WORKLOAD_H */
@@ -1,12 +1,20 @@
 #include "GroundingSpace.h"
 
 #include <map>
+#include <mutex>
+#include <limits>
+#include <deque>
 #include <memory>
 #include <algorithm>
 #include <stdexcept>
 #include <functional>
 
 #include "logger_priv.h"
+#include "profiler_priv.h"
+#include "tracer_priv.h"
+#include "interpreter_priv.h"
+#include "WorkStealingPool.h"
+#include "RuleMachine.h"
 
 // Atom
 
@@ -37,55 +45,922 @@ std::string to_string(std::vector<AtomPtr> const& atoms, std::string delimiter)
     return str;
 }
 
+// Symbol table
+
+SymbolTable& SymbolTable::instance() {
+    // Table is never destroyed because symbols can be released by other
+    // static objects after it
+    static SymbolTable* table = new SymbolTable();
+    return *table;
+}
+
+SymbolTable& SymbolTable::variables() {
+    static SymbolTable* table = new SymbolTable();
+    return *table;
+}
+
+SymbolId SymbolTable::add_name(std::string_view name) {
+    SymbolId id = names.size();
+    names.emplace_back(name);
+    atoms.emplace_back();
+    return id;
+}
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    SymbolId id = add_name(name);
+    ids.emplace(names.back(), id);
+    return id;
+}
+
+SymbolId SymbolTable::unique(std::string_view name) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return add_name(name);
+}
+
+std::string const& SymbolTable::get_name(SymbolId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return names.at(id);
+}
+
+SymbolAtomPtr SymbolTable::get_atom(std::string_view name) {
+    SymbolId id = intern(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (atoms[id]) {
+            return atoms[id];
+        }
+    }
+    SymbolAtomPtr atom = std::make_shared<SymbolAtom>(id);
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (!atoms[id]) {
+        atoms[id] = atom;
+    }
+    return atoms[id];
+}
+
+size_t SymbolTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return names.size();
+}
+
+// Variable atom
+
+static std::atomic<VariableId> next_unique_variable_id{
+    static_cast<VariableId>(std::numeric_limits<SymbolId>::max()) + 1 };
+
+// Each thread takes ids of unique variables from the shared counter in
+// blocks, so threads renaming variables don't contend on the counter
+static const VariableId UNIQUE_VARIABLE_ID_BLOCK = 1024;
+static thread_local VariableId next_thread_variable_id = 0;
+static thread_local VariableId end_thread_variable_id = 0;
+
+VariableAtomPtr VariableAtom::fresh() const {
+    if (next_thread_variable_id == end_thread_variable_id) {
+        next_thread_variable_id = next_unique_variable_id.fetch_add(UNIQUE_VARIABLE_ID_BLOCK);
+        end_thread_variable_id = next_thread_variable_id + UNIQUE_VARIABLE_ID_BLOCK;
+    }
+    return VariableAtomPtr(new VariableAtom(next_thread_variable_id++, name));
+}
+
+VariableAtomPtr VariableAtom::unique(std::string const& name) {
+    return VariableAtom(name).fresh();
+}
+
+// Expression atom
+
 bool ExprAtom::operator==(Atom const& _other) const { 
+    if (this == &_other) {
+        return true;
+    }
     if (_other.get_type() != EXPR) {
         return false;
     }
     ExprAtom const& other = static_cast<ExprAtom const&>(_other);
+    if (canonical && other.canonical) {
+        return false;
+    }
+    if (frozen && other.frozen && hash_value != other.hash_value) {
+        return false;
+    }
     return children == other.children;
 }
 
-// Grounding space
+void ExprAtom::set_child(size_t index, AtomPtr child) {
+    if (frozen) {
+        throw std::logic_error("Frozen expression cannot be modified: " + to_string());
+    }
+    children.at(index) = child;
+}
+
+void ExprAtom::freeze() {
+    if (frozen) {
+        return;
+    }
+    for (auto const& child : children) {
+        if (child->get_type() == EXPR) {
+            std::static_pointer_cast<ExprAtom>(child)->freeze();
+        }
+    }
+    hash_value = calculate_hash(children);
+    frozen = true;
+}
+
+size_t ExprAtom::calculate_hash(std::vector<AtomPtr> const& children) {
+    size_t hash = std::hash<int>()(EXPR);
+    for (auto const& child : children) {
+        hash = hash_combine(hash, child->hash());
+    }
+    return hash;
+}
+
+// Expression table
+
+ExprTable& ExprTable::instance() {
+    // Table is never destroyed because expressions can be released by other
+    // static objects after it
+    static ExprTable* table = new ExprTable();
+    return *table;
+}
+
+// Children created before hash consing is enabled can be read by other
+// threads, so they are replaced by canonical expressions instead of being
+// frozen in place
+ExprAtomPtr ExprTable::intern(std::vector<AtomPtr> children) {
+    for (auto& child : children) {
+        if (child->get_type() == Atom::EXPR) {
+            ExprAtom const& expr = static_cast<ExprAtom const&>(*child);
+            if (!expr.canonical) {
+                child = intern(expr.children);
+            }
+        }
+    }
+    size_t hash = ExprAtom::calculate_hash(children);
+    Shard& shard = get_shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.exprs.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // Expression is deleted only after release() removed it from the
+        // table, so pointer is valid while mutex is locked
+        if (it->second.expr->children == children) {
+            ExprAtomPtr expr = it->second.ref.lock();
+            if (expr) {
+                return expr;
+            }
+        }
+    }
+    ExprAtom* expr = new ExprAtom(std::move(children));
+    expr->hash_value = hash;
+    expr->frozen = true;
+    expr->canonical = true;
+    ExprAtomPtr ptr(expr, [hash](ExprAtom* expr) -> void {
+                ExprTable::instance().release(hash);
+                delete expr;
+            });
+    shard.exprs.emplace(hash, Entry{ expr, ptr });
+    return ptr;
+}
+
+void ExprTable::release(size_t hash) {
+    Shard& shard = get_shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.exprs.equal_range(hash);
+    for (auto it = range.first; it != range.second; ) {
+        if (it->second.ref.expired()) {
+            it = shard.exprs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ExprTable::size() const {
+    size_t size = 0;
+    for (auto const& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.exprs.size();
+    }
+    return size;
+}
+
+// Atom index
+
+const size_t AtomIndex::NOT_EXPR = static_cast<size_t>(-1);
+
+static bool is_index_key(AtomPtr const& atom) {
+    return atom->get_type() == Atom::SYMBOL || atom->get_type() == Atom::GROUNDED;
+}
+
+AtomIndex::Positions* AtomIndex::find_positions(AtomPtr const& atom) {
+    switch (atom->get_type()) {
+        case Atom::SYMBOL:
+        case Atom::GROUNDED:
+            return &atoms[{ NOT_EXPR, atom }];
+        case Atom::VARIABLE:
+            return &variables;
+        case Atom::EXPR:
+            {
+                auto const& children = std::static_pointer_cast<ExprAtom>(atom)->get_children();
+                if (children.empty()) {
+                    return nullptr;
+                }
+                AtomPtr const& head = children[0];
+                if (is_index_key(head)) {
+                    return &atoms[{ children.size(), head }];
+                } else if (head->get_type() == Atom::VARIABLE) {
+                    return &variable_heads[children.size()];
+                } else {
+                    return &expression_heads[children.size()];
+                }
+            }
+        default:
+            throw std::logic_error("Not implemented for type: " +
+                    to_string(atom->get_type()));
+    }
+}
+
+static AtomPtr const EQUAL = S("=");
+
+// Minimal number of function clauses to build argument indexes
+static const size_t MIN_ARG_INDEX_CLAUSES = 2;
+
+static bool is_rule(AtomPtr const& atom) {
+    if (atom->get_type() != Atom::EXPR) {
+        return false;
+    }
+    auto const& children = std::static_pointer_cast<ExprAtom>(atom)->get_children();
+    return children.size() == 3 && *children[0] == *EQUAL;
+}
+
+// Returns (f args...) part of the (= (f args...) body) rule when f can be
+// used as a key of the rule table
+static ExprAtomPtr get_rule_call(AtomPtr const& rule) {
+    AtomPtr const& call = std::static_pointer_cast<ExprAtom>(rule)->get_children()[1];
+    if (call->get_type() != Atom::EXPR) {
+        return nullptr;
+    }
+    ExprAtomPtr expr = std::static_pointer_cast<ExprAtom>(call);
+    if (expr->get_children().empty() || !is_index_key(expr->get_children()[0])) {
+        return nullptr;
+    }
+    return expr;
+}
+
+AtomIndex::Positions& AtomIndex::arg_positions(ArgIndex& index, AtomPtr const& arg) {
+    return is_index_key(arg) ? index.constants[arg] : index.others;
+}
+
+static void pop_position(AtomIndex::Positions& positions, size_t position,
+        AtomPtr const& atom) {
+    if (positions.empty() || positions.back() != position) {
+        throw std::logic_error("Atom is not the last one added to the index: " +
+                atom->to_string());
+    }
+    positions.pop_back();
+}
+
+void AtomIndex::add(AtomPtr const& atom, size_t position) {
+    Positions* positions = find_positions(atom);
+    if (positions) {
+        positions->push_back(position);
+    }
+    if (!is_rule(atom)) {
+        return;
+    }
+    ExprAtomPtr call = get_rule_call(atom);
+    if (!call) {
+        generic_rules.push_back(position);
+        return;
+    }
+    auto const& args = call->get_children();
+    Function& function = functions.try_emplace({ args.size(), args[0] }, args.size()).first->second;
+    function.clauses.push_back(position);
+    function.calls.push_back(call);
+    for (size_t i = 0; i < function.arity; ++i) {
+        ArgIndex* index = function.arg_indexes[i].load(std::memory_order_relaxed);
+        if (index) {
+            arg_positions(*index, args[i]).push_back(position);
+        }
+    }
+}
+
+void AtomIndex::remove_last(AtomPtr const& atom, size_t position) {
+    Positions* positions = find_positions(atom);
+    if (positions) {
+        pop_position(*positions, position, atom);
+    }
+    if (!is_rule(atom)) {
+        return;
+    }
+    ExprAtomPtr call = get_rule_call(atom);
+    if (!call) {
+        pop_position(generic_rules, position, atom);
+        return;
+    }
+    auto const& args = call->get_children();
+    Function& function = functions.find({ args.size(), args[0] })->second;
+    pop_position(function.clauses, position, atom);
+    function.calls.pop_back();
+    for (size_t i = 0; i < function.arity; ++i) {
+        ArgIndex* arg_index = function.arg_indexes[i].load(std::memory_order_relaxed);
+        if (arg_index) {
+            ArgIndex& index = *arg_index;
+            Positions& positions = arg_positions(index, args[i]);
+            pop_position(positions, position, atom);
+            if (positions.empty() && &positions != &index.others) {
+                index.constants.erase(args[i]);
+            }
+        }
+    }
+}
+
+AtomIndex::Function::~Function() {
+    for (size_t i = 0; i < arity; ++i) {
+        delete arg_indexes[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Argument indexes are built rarely so single lock is shared by all of them
+static std::mutex arg_index_mutex;
+
+AtomIndex::ArgIndex const& AtomIndex::get_arg_index(Function const& function, size_t arg) {
+    ArgIndex* index = function.arg_indexes[arg].load(std::memory_order_acquire);
+    if (index) {
+        return *index;
+    }
+    std::lock_guard<std::mutex> lock(arg_index_mutex);
+    index = function.arg_indexes[arg].load(std::memory_order_relaxed);
+    if (!index) {
+        LOG_DEBUG << "build index for argument " << arg << " of function " <<
+            function.calls[0]->get_children()[0]->to_string() << std::endl;
+        index = new ArgIndex();
+        for (size_t i = 0; i < function.clauses.size(); ++i) {
+            arg_positions(*index, function.calls[i]->get_children()[arg])
+                .push_back(function.clauses[i]);
+        }
+        function.arg_indexes[arg].store(index, std::memory_order_release);
+    }
+    return *index;
+}
+
+bool AtomIndex::rule_candidates(AtomPtr const& pattern, Candidates& candidates) const {
+    if (!is_rule(pattern)) {
+        return false;
+    }
+    ExprAtomPtr call = get_rule_call(pattern);
+    if (!call) {
+        return false;
+    }
+    if (!generic_rules.empty()) {
+        candidates.lists.push_back(&generic_rules);
+    }
+    auto const& args = call->get_children();
+    auto it = functions.find({ args.size(), args[0] });
+    if (it == functions.end() || it->second.clauses.empty()) {
+        return true;
+    }
+    Function const& function = it->second;
+    // select argument which leaves the least number of clauses to unify
+    Positions const* best_constants = nullptr;
+    Positions const* best_others = &function.clauses;
+    size_t best_size = function.clauses.size();
+    if (function.clauses.size() >= MIN_ARG_INDEX_CLAUSES) {
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!is_index_key(args[i])) {
+                continue;
+            }
+            ArgIndex const& index = get_arg_index(function, i);
+            auto constants = index.constants.find(args[i]);
+            Positions const* found = constants != index.constants.end() ?
+                &constants->second : nullptr;
+            size_t size = (found ? found->size() : 0) + index.others.size();
+            if (size < best_size) {
+                best_constants = found;
+                best_others = &index.others;
+                best_size = size;
+            }
+        }
+    }
+    if (best_constants) {
+        candidates.lists.push_back(best_constants);
+    }
+    if (!best_others->empty()) {
+        candidates.lists.push_back(best_others);
+    }
+    return true;
+}
+
+void AtomIndex::add_list(Candidates& candidates,
+        std::unordered_map<size_t, Positions> const& lists, size_t arity) const {
+    auto it = lists.find(arity);
+    if (it != lists.end() && !it->second.empty()) {
+        candidates.lists.push_back(&it->second);
+    }
+}
+
+AtomIndex::Candidates AtomIndex::candidates(AtomPtr const& pattern, bool expression_heads) const {
+    Candidates result;
+    AtomPtr key;
+    size_t arity = NOT_EXPR;
+    if (is_index_key(pattern)) {
+        key = pattern;
+    } else if (pattern->get_type() == Atom::EXPR) {
+        auto const& children = std::static_pointer_cast<ExprAtom>(pattern)->get_children();
+        if (!children.empty() && is_index_key(children[0])) {
+            key = children[0];
+            arity = children.size();
+        }
+    }
+    if (!key) {
+        result.all = true;
+        return result;
+    }
+    if (!variables.empty()) {
+        result.lists.push_back(&variables);
+    }
+    if (!rule_candidates(pattern, result)) {
+        auto it = atoms.find({ arity, key });
+        if (it != atoms.end() && !it->second.empty()) {
+            result.lists.push_back(&it->second);
+        }
+    }
+    if (arity != NOT_EXPR) {
+        add_list(result, variable_heads, arity);
+        if (expression_heads) {
+            add_list(result, this->expression_heads, arity);
+        }
+    }
+    return result;
+}
+
+AtomIndex::Iterator::Iterator(Candidates candidates, size_t size)
+    : candidates(std::move(candidates)), size(size) {
+    next_positions.resize(this->candidates.all ? 1 : this->candidates.lists.size(), 0);
+}
+
+bool AtomIndex::Iterator::next(size_t& position) {
+    if (candidates.all) {
+        if (next_positions[0] < size) {
+            position = next_positions[0]++;
+            return true;
+        }
+        return false;
+    }
+    // merge sorted lists to visit candidates in order of content
+    size_t min = candidates.lists.size();
+    size_t min_position = 0;
+    for (size_t i = 0; i < next_positions.size(); ++i) {
+        Positions const& list = *candidates.lists[i];
+        if (next_positions[i] == list.size()) {
+            continue;
+        }
+        size_t head = list[next_positions[i]];
+        if (!candidates.ends.empty() && head >= candidates.ends[i]) {
+            continue;
+        }
+        if (min == candidates.lists.size() || head < min_position) {
+            min = i;
+            min_position = head;
+        }
+    }
+    // atoms added after iterator is created are not visited
+    if (min == candidates.lists.size() || min_position >= size) {
+        return false;
+    }
+    ++next_positions[min];
+    position = min_position;
+    return true;
+}
+
+AtomIndex::Candidates AtomIndex::match_candidates(AtomPtr const& pattern) const {
+    return candidates(pattern, false);
+}
+
+AtomIndex::Candidates AtomIndex::unify_candidates(AtomPtr const& atom) const {
+    // expression in a head position can be unified with symbol by adding
+    // delayed unification, see unify_atoms()
+    return candidates(atom, true);
+}
+
+// Grounded atom
+
+// Set when default execute() implementation calls the other one, the other
+// one being also default means that none of them is overridden
+static thread_local GroundedAtom const* adapting_execute = nullptr;
+
+class AdaptingExecute {
+public:
+    AdaptingExecute(GroundedAtom const* atom) {
+        if (adapting_execute == atom) {
+            throw std::runtime_error("Operation is not supported");
+        }
+        prev = adapting_execute;
+        adapting_execute = atom;
+    }
+    ~AdaptingExecute() { adapting_execute = prev; }
+private:
+    GroundedAtom const* prev;
+};
+
+class GroundingSpaceSink : public AtomSink {
+public:
+    GroundingSpaceSink(GroundingSpace& space) : space(space) { }
+    virtual ~GroundingSpaceSink() { }
+    void add_atom(AtomPtr atom) override { space.add_atom(atom); }
+private:
+    GroundingSpace& space;
+};
+
+void GroundedAtom::execute(AtomSpan args, AtomSink& result) const {
+    AdaptingExecute adapting(this);
+    GroundingSpace args_space(std::vector<AtomPtr>(args.begin(), args.end()));
+    GroundingSpace result_space;
+    execute(args_space, result_space);
+    for (auto const& atom : result_space.get_content()) {
+        result.add_atom(atom);
+    }
+}
+
+void GroundedAtom::execute(GroundingSpace const& args, GroundingSpace& result) const {
+    AdaptingExecute adapting(this);
+    GroundingSpaceSink sink(result);
+    execute(AtomSpan(args.get_content()), sink);
+}
+
+// Grounding space
+
+std::string GroundingSpace::TYPE = "GroundingSpace";
+
+// Published version of the space
+GroundingSpace::GroundingSpace(GroundingSpace const& space, size_t segments)
+    : storage(space.storage), content_size(space.content_size),
+    removed_count(space.removed_count), rule_removals(space.rule_removals),
+    compactions(space.compactions), epoch(space.epoch),
+    segments(space.segments.begin(), space.segments.begin() + segments),
+    rules_compiled(space.rules_compiled), is_version(true),
+    counters(space.counters) {
+}
+
+void GroundingSpace::add_atom(AtomPtr atom) {
+    if (segments.back().index.use_count() > 1 || segments.back().end != content_size) {
+        seal_segment();
+    }
+    segments.back().index->add(atom, content_size);
+    ++segments.back().end;
+    storage->content.push_back(atom);
+    storage->removed.push_back(Removal());
+    if (rules_compiled) {
+        compile_rule(atom);
+    }
+    ++content_size;
+}
+
+bool GroundingSpace::remove_atom(AtomPtr atom) {
+    AtomIndex::Iterator it(candidates(atom, false), content_size);
+    size_t position;
+    while (it.next(position)) {
+        if (!is_removed(position) && *get_atom(position) == *atom) {
+            remove_position(position);
+            compact();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GroundingSpace::replace_atom(AtomPtr atom, AtomPtr replacement) {
+    if (!remove_atom(atom)) {
+        return false;
+    }
+    add_atom(replacement);
+    return true;
+}
+
+size_t GroundingSpace::remove_matching(AtomPtr pattern) {
+    std::vector<size_t> positions;
+    MatchCursor cursor(*this, pattern);
+    while (cursor.next()) {
+        positions.push_back(cursor.get_position());
+    }
+    for (size_t position : positions) {
+        remove_position(position);
+    }
+    compact();
+    return positions.size();
+}
+
+// Atom is marked by the number of the next publication, so versions which
+// are published before still contain it
+void GroundingSpace::remove_position(size_t position) {
+    LOG_DEBUG << "remove atom: " << get_atom(position)->to_string() << std::endl;
+    storage->removed[position].epoch.store(epoch, std::memory_order_relaxed);
+    ++removed_count;
+    if (is_rule(get_atom(position))) {
+        ++rule_removals;
+    }
+}
+
+// Moves atoms which are not removed into the new storage and indexes them
+// again when more than half of the content is removed
+void GroundingSpace::compact() {
+    if (2 * removed_count <= content_size) {
+        return;
+    }
+    LOG_DEBUG << "compact content, removed " << removed_count <<
+        " of " << content_size << " atoms" << std::endl;
+    auto compacted = std::make_shared<Storage>();
+    auto index = std::make_shared<AtomIndex>();
+    size_t size = this->size();
+    for (size_t i = 0; i < content_size; ++i) {
+        if (is_removed(i)) {
+            continue;
+        }
+        index->add(storage->content[i], compacted->content.size());
+        compacted->content.push_back(storage->content[i]);
+        compacted->removed.push_back(Removal());
+        if (rules_compiled) {
+            compacted->compiled.push_back(storage->compiled[i]);
+        }
+    }
+    storage = std::move(compacted);
+    content_size = size;
+    removed_count = 0;
+    ++compactions;
+    segments.assign(1, { std::move(index), 0, size });
+}
+
+AtomPtr GroundingSpace::pop_atom() {
+    AtomPtr atom = storage->content[content_size - 1];
+    while (pop_position()) {
+        atom = storage->content[content_size - 1];
+    }
+    return atom;
+}
+
+// Removes the last position, returns true when it keeps removed atom
+bool GroundingSpace::pop_position() {
+    if (storage_shared()) {
+        detach_storage();
+    }
+    while (segments.size() > 1 && segments.back().begin == content_size) {
+        segments.pop_back();
+    }
+    bool removed = is_removed(content_size - 1);
+    --content_size;
+    // position is left in the index which is shared with versions or
+    // cursors or keeps popped positions already
+    Segment& last = segments.back();
+    if (last.end == content_size + 1 && last.index.use_count() == 1) {
+        last.index->remove_last(storage->content.back(), content_size);
+        last.end = content_size;
+    }
+    storage->content.pop_back();
+    storage->removed.pop_back();
+    if (rules_compiled) {
+        storage->compiled.pop_back();
+    }
+    if (removed) {
+        --removed_count;
+    }
+    return removed;
+}
+
+void GroundingSpace::compile_rules() {
+    if (rules_compiled) {
+        return;
+    }
+    if (storage_shared()) {
+        detach_storage();
+    }
+    rules_compiled = true;
+    for (size_t i = 0; i < content_size; ++i) {
+        compile_rule(storage->content[i]);
+    }
+}
+
+void GroundingSpace::compile_rule(AtomPtr const& atom) {
+    storage->compiled.push_back(is_rule(atom) ? std::make_shared<CompiledRule>(atom) : nullptr);
+}
+
+// Copies the storage used by published version, so it can be modified
+void GroundingSpace::detach_storage() {
+    auto copy = std::make_shared<Storage>();
+    for (size_t i = 0; i < content_size; ++i) {
+        copy->content.push_back(storage->content[i]);
+        copy->removed.push_back(storage->removed[i]);
+        if (rules_compiled) {
+            copy->compiled.push_back(storage->compiled[i]);
+        }
+    }
+    storage = std::move(copy);
+}
+
+// Merges the last segment with the previous one while the previous one is
+// less than twice as large, so the number of segments is logarithmic in the
+// size of the content. Removed atoms are indexed until the content is
+// compacted, so pop_position() can remove the last atom from the index.
+void GroundingSpace::merge_segments() {
+    while (segments.size() > 1) {
+        Segment const& last = segments.back();
+        Segment const& prev = segments[segments.size() - 2];
+        if (last.begin - prev.begin > 2 * (content_size - last.begin)) {
+            break;
+        }
+        auto index = std::make_shared<AtomIndex>();
+        for (size_t i = prev.begin; i < content_size; ++i) {
+            index->add(storage->content[i], i);
+        }
+        segments.pop_back();
+        segments.back().index = std::move(index);
+        segments.back().end = content_size;
+    }
+}
+
+// Starts a new segment to index atoms when the last one is shared or keeps
+// popped positions
+void GroundingSpace::seal_segment() {
+    merge_segments();
+    Segment& last = segments.back();
+    if (last.index.use_count() == 1 && last.end == content_size) {
+        return;
+    }
+    if (last.begin == content_size) {
+        last.index = std::make_shared<AtomIndex>();
+        last.end = content_size;
+    } else {
+        segments.push_back({ std::make_shared<AtomIndex>(), content_size, content_size });
+    }
+}
+
+// Version shares all segments except the empty last one, atoms removed
+// after it are marked by the next epoch
+std::shared_ptr<GroundingSpace const> GroundingSpace::view() {
+    if (content_size > segments.back().begin) {
+        merge_segments();
+        segments.push_back({ std::make_shared<AtomIndex>(), content_size, content_size });
+    }
+    std::shared_ptr<GroundingSpace const> version(
+            new GroundingSpace(*this, segments.size() - 1));
+    ++epoch;
+    return version;
+}
+
+void GroundingSpace::publish() {
+    std::shared_ptr<GroundingSpace const> published = view();
+    std::atomic_store(&version, published);
+    LOG_DEBUG << "publish version of " << content_size << " atoms in " <<
+        published->segments.size() << " segments" << std::endl;
+}
+
+SpaceStats GroundingSpace::get_stats() const {
+    return { counters->queries.load(std::memory_order_relaxed),
+        counters->candidates_scanned.load(std::memory_order_relaxed),
+        counters->candidates_matched.load(std::memory_order_relaxed),
+        size() };
+}
+
+std::shared_ptr<GroundingSpace const> GroundingSpace::snapshot() const {
+    static std::shared_ptr<GroundingSpace const> const empty =
+        std::make_shared<GroundingSpace const>();
+    std::shared_ptr<GroundingSpace const> published = std::atomic_load(&version);
+    return published ? published : empty;
+}
+
+// Size of the storage can be changed by writer while version is read, so
+// the atoms are copied by positions
+std::vector<AtomPtr> GroundingSpace::get_content() const {
+    std::vector<AtomPtr> atoms;
+    atoms.reserve(size());
+    for (size_t i = 0; i < content_size; ++i) {
+        if (!is_removed(i)) {
+            atoms.push_back(get_atom(i));
+        }
+    }
+    return atoms;
+}
+
+AtomIndex::Candidates GroundingSpace::candidates(AtomPtr const& atom, bool unify) const {
+    if (segments.size() == 1) {
+        return unify ? segments[0].index->unify_candidates(atom)
+            : segments[0].index->match_candidates(atom);
+    }
+    AtomIndex::Candidates result;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        AtomIndex::Candidates candidates = unify ? segments[i].index->unify_candidates(atom)
+            : segments[i].index->match_candidates(atom);
+        if (candidates.all) {
+            return candidates;
+        }
+        // segment can keep positions which are popped and reused by the
+        // next segments
+        size_t end = i + 1 < segments.size() ? segments[i + 1].begin : content_size;
+        result.lists.insert(result.lists.end(), candidates.lists.begin(), candidates.lists.end());
+        result.ends.insert(result.ends.end(), candidates.lists.size(), end);
+    }
+    return result;
+}
+
+void GroundingSpace::for_each_candidate(AtomIndex::Candidates const& candidates,
+        std::function<void(AtomPtr const&)> visit) const {
+    AtomIndex::Iterator it(candidates, content_size);
+    size_t position;
+    while (it.next(position)) {
+        if (!is_removed(position)) {
+            visit(get_atom(position));
+        }
+    }
+}
+
+// Match
+
+// Flat store of bindings used while matching a single candidate. Bindings
+// are appended to a small array and never overwritten, so the array is also
+// a trail: undo() removes the bindings added after the mark without
+// reallocation. Store keeps pointers to the atoms which are matched, so
+// these atoms should outlive it.
+class BindingStore {
+public:
+    using Mark = size_t;
+
+    AtomPtr const* find(AtomPtr const& var) const {
+        VariableId id = static_cast<VariableAtom const&>(*var).get_id();
+        for (auto const& binding : bindings) {
+            if (binding.id == id) {
+                return binding.value;
+            }
+        }
+        return nullptr;
+    }
+    bool add(AtomPtr const& var, AtomPtr const& value) {
+        AtomPtr const* cur = find(var);
+        if (cur) {
+            return **cur == *value;
+        }
+        bindings.push_back({ static_cast<VariableAtom const&>(*var).get_id(), &var, &value });
+        return true;
+    }
+    Mark mark() const { return bindings.size(); }
+    void undo(Mark mark) { bindings.resize(mark); }
+    void clear() { undo(0); }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (auto const& binding : bindings) {
+            f(*binding.var, *binding.value);
+        }
+    }
 
-std::string GroundingSpace::TYPE = "GroundingSpace";
+private:
+    struct Binding {
+        VariableId id;
+        AtomPtr const* var;
+        AtomPtr const* value;
+    };
 
-// Match
+    std::vector<Binding> bindings;
+};
 
 struct MatchBindings {
-    Bindings a_bindings;
-    Bindings b_bindings;
-};
+    BindingStore a_bindings;
+    BindingStore b_bindings;
 
-bool add_binding(Bindings& bindings, AtomPtr _var, AtomPtr value) {
-    VariableAtomPtr var = std::static_pointer_cast<VariableAtom>(_var);
-    auto cur = bindings.find(var);
-    if (cur != bindings.end()) {
-        return *(cur->second) == *value;
-    } 
-    bindings[var] = value;
-    return true;
-}
+    void clear() {
+        a_bindings.clear();
+        b_bindings.clear();
+    }
+};
 
-static bool match_atoms(AtomPtr a, AtomPtr b, MatchBindings& match) {
+static bool match_atoms(AtomPtr const& a, AtomPtr const& b, MatchBindings& match) {
     // TODO: it is not clear how should we handle the case when a and b are
     // both variables. We can check variable name equality and skip binding. We
     // can add a as binding for b and vice versa.
     if (b->get_type() == Atom::VARIABLE) {
-        return add_binding(match.b_bindings, b, a);
+        return match.b_bindings.add(b, a);
     }
     switch (a->get_type()) {
         case Atom::SYMBOL:
         case Atom::GROUNDED:
             return *a == *b;
         case Atom::VARIABLE:
-            return add_binding(match.a_bindings, a, b);
+            return match.a_bindings.add(a, b);
         case Atom::EXPR:
             {
                 if (b->get_type() != Atom::EXPR) {
                     return false;
                 }
-                std::vector<AtomPtr>& childrenA = std::static_pointer_cast<ExprAtom>(a)->get_children();
-                std::vector<AtomPtr>& childrenB = std::static_pointer_cast<ExprAtom>(b)->get_children();
+                std::vector<AtomPtr> const& childrenA = std::static_pointer_cast<ExprAtom>(a)->get_children();
+                std::vector<AtomPtr> const& childrenB = std::static_pointer_cast<ExprAtom>(b)->get_children();
                 if (childrenA.size() != childrenB.size()) {
                     return false;
                 }
@@ -102,31 +977,61 @@ static bool match_atoms(AtomPtr a, AtomPtr b, MatchBindings& match) {
     }
 }
 
-static AtomPtr apply_bindings_to_atom(AtomPtr const& atom, Bindings const& bindings) {
+static AtomPtr const* find_binding(Bindings const& bindings, AtomPtr const& var) {
+    auto const& pair = bindings.find(std::static_pointer_cast<VariableAtom>(var));
+    return pair != bindings.end() ? &pair->second : nullptr;
+}
+
+static AtomPtr const* find_binding(BindingStore const& bindings, AtomPtr const& var) {
+    return bindings.find(var);
+}
+
+// Binds each unbound variable to a fresh one on the first lookup, it is
+// used to rename variables of the rule apart when the rule is applied
+struct RenamingBindings {
+    BindingStore& bindings;
+    std::deque<AtomPtr>& fresh;
+};
+
+static AtomPtr const* find_binding(RenamingBindings const& renaming, AtomPtr const& var) {
+    AtomPtr const* value = renaming.bindings.find(var);
+    if (!value) {
+        renaming.fresh.push_back(static_cast<VariableAtom const&>(*var).fresh());
+        value = &renaming.fresh.back();
+        renaming.bindings.add(var, *value);
+    }
+    return value;
+}
+
+// Returns atom itself when there is nothing to replace inside
+template <typename B>
+static AtomPtr apply_bindings_to_atom(AtomPtr const& atom, B const& bindings) {
     switch (atom->get_type()) {
         case Atom::SYMBOL:
         case Atom::GROUNDED:
             return atom;
         case Atom::VARIABLE:
             {
-                VariableAtomPtr var = std::static_pointer_cast<VariableAtom>(atom);
-                auto const& pair = bindings.find(var);
-                if (pair != bindings.end()) {
-                    return pair->second;
-                } else {
-                    return atom;
-                }
+                AtomPtr const* value = find_binding(bindings, atom);
+                return value ? *value : atom;
             }
         case Atom::EXPR:
             {
-                ExprAtomPtr expr = std::static_pointer_cast<ExprAtom>(atom);
+                auto const& expr_children = std::static_pointer_cast<ExprAtom>(atom)->get_children();
                 std::vector<AtomPtr> children;
-                for (auto const& atom : expr->get_children()) {
-                    AtomPtr applied = apply_bindings_to_atom(atom, bindings);
-                    children.push_back(applied);
+                bool changed = false;
+                for (size_t i = 0; i < expr_children.size(); ++i) {
+                    AtomPtr applied = apply_bindings_to_atom(expr_children[i], bindings);
+                    if (!changed && applied != expr_children[i]) {
+                        changed = true;
+                        children.reserve(expr_children.size());
+                        children.assign(expr_children.begin(), expr_children.begin() + i);
+                    }
+                    if (changed) {
+                        children.push_back(applied);
+                    }
                 }
-                AtomPtr grounded_expr = E(children);
-                return grounded_expr;
+                return changed ? E(children) : atom;
             }
         default:
             throw std::logic_error("Not implemented for type: " +
@@ -134,12 +1039,19 @@ static AtomPtr apply_bindings_to_atom(AtomPtr const& atom, Bindings const& bindi
     }
 }
 
-static Bindings apply_bindings_to_bindings(Bindings from, Bindings to) {
+// Converts bindings of the store into Bindings value, applying bindings
+// from the other store to the values
+AtomPtr apply_bindings_to_atom(AtomPtr const& atom, Bindings const& bindings) {
+    return apply_bindings_to_atom<Bindings>(atom, bindings);
+}
+
+template <typename B>
+static Bindings apply_bindings_to_bindings(B const& from, BindingStore const& to) {
     Bindings result;
-    for (auto const& pair : to) {
-        AtomPtr applied = apply_bindings_to_atom(pair.second, from);
-        result[pair.first] = applied;
-    }
+    to.for_each([&result, &from](AtomPtr const& var, AtomPtr const& value) -> void {
+            result[std::static_pointer_cast<VariableAtom>(var)] =
+                apply_bindings_to_atom(value, from);
+        });
     return result;
 }
 
@@ -152,22 +1064,98 @@ static void apply_bindings_to_templ(GroundingSpace& target,
     }
 }
 
-std::vector<Bindings> GroundingSpace::match(AtomPtr pattern) const {
-    std::vector<Bindings> result;
+MatchCursor::MatchCursor(GroundingSpace const& space, AtomPtr pattern)
+    : storage(space.storage), counters(space.counters),
+    visible_epoch(space.visible_epoch()), pattern(pattern),
+    candidates(space.candidates(pattern, false), space.content_size),
+    bindings(new MatchBindings()) {
     LOG_DEBUG << "pattern: " << pattern->to_string() << std::endl;
-    for (auto const& match : get_content()) {
-        MatchBindings bindings;
-        if (!match_atoms(match, pattern, bindings)) {
+    indexes.reserve(space.segments.size());
+    for (auto const& segment : space.segments) {
+        indexes.push_back(segment.index);
+    }
+}
+
+MatchCursor::MatchCursor(MatchCursor&& other) = default;
+
+MatchCursor::~MatchCursor() {
+    // moved from cursor has no bindings
+    if (!bindings) {
+        return;
+    }
+    counters->queries.fetch_add(1, std::memory_order_relaxed);
+    counters->candidates_scanned.fetch_add(scanned, std::memory_order_relaxed);
+    counters->candidates_matched.fetch_add(matched, std::memory_order_relaxed);
+    Stats::add(Stats::CANDIDATES_SCANNED, scanned);
+    Stats::add(Stats::CANDIDATES_MATCHED, matched);
+    Stats::add(Stats::BINDINGS_CREATED, bound);
+}
+
+bool MatchCursor::is_removed(size_t position) const {
+    size_t removed = storage->removed[position].epoch.load(std::memory_order_relaxed);
+    return removed != 0 && removed <= visible_epoch;
+}
+
+bool MatchCursor::next() {
+    while (candidates.next(position)) {
+        if (is_removed(position)) {
             continue;
         }
-        bindings.b_bindings = apply_bindings_to_bindings(bindings.a_bindings,
-                bindings.b_bindings);
-        result.emplace_back(bindings.b_bindings);
+        ++scanned;
+        bindings->clear();
+        if (match_atoms(storage->content[position], pattern, *bindings)) {
+            ++matched;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MatchCursor::next(Bindings& result) {
+    if (!next()) {
+        return false;
+    }
+    result = apply_bindings_to_bindings(bindings->a_bindings, bindings->b_bindings);
+    ++bound;
+    return true;
+}
+
+std::vector<Bindings> GroundingSpace::match(AtomPtr pattern) const {
+    return match(pattern, std::numeric_limits<size_t>::max());
+}
+
+std::vector<Bindings> GroundingSpace::match(AtomPtr pattern, size_t limit) const {
+    TRACE_SCOPE("match");
+    Stats::Timer timer(Stats::MATCH_LATENCY);
+    std::vector<Bindings> result;
+    MatchCursor cursor(*this, pattern);
+    Bindings bindings;
+    while (result.size() < limit && cursor.next(bindings)) {
+        result.push_back(std::move(bindings));
     }
     return result;
 }
 
+bool GroundingSpace::exists(AtomPtr pattern) const {
+    TRACE_SCOPE("match");
+    Stats::Timer timer(Stats::MATCH_LATENCY);
+    return MatchCursor(*this, pattern).next();
+}
+
+size_t GroundingSpace::count(AtomPtr pattern) const {
+    TRACE_SCOPE("match");
+    Stats::Timer timer(Stats::MATCH_LATENCY);
+    MatchCursor cursor(*this, pattern);
+    size_t count = 0;
+    while (cursor.next()) {
+        ++count;
+    }
+    return count;
+}
+
 void GroundingSpace::match(SpaceAPI const& _pattern, SpaceAPI const& _templ, GroundingSpace& target) const {
+    TRACE_SCOPE("match");
+    Stats::Timer timer(Stats::MATCH_LATENCY);
     if (_pattern.get_type() != GroundingSpace::TYPE) {
         throw std::runtime_error("_pattern is expected to be GroundingSpace");
     }
@@ -176,37 +1164,273 @@ void GroundingSpace::match(SpaceAPI const& _pattern, SpaceAPI const& _templ, Gro
         throw std::runtime_error("_templ is expected to be GroundingSpace");
     }
     GroundingSpace const& templ = static_cast<GroundingSpace const&>(_templ);
-    if (pattern.content.size() != 1) {
-        throw std::logic_error("_pattern with more than one clause is not supported");
+    if (pattern.size() == 0) {
+        throw std::logic_error("_pattern without clauses is not supported");
     }
     LOG_DEBUG << "pattern: " << pattern.to_string() <<
         ", templ: " << templ.to_string() << std::endl;
-    AtomPtr pattern_atom = pattern.content[0];
-    std::vector<Bindings> results = match(pattern_atom);
-    for (auto const& result : results) {
-        apply_bindings_to_templ(target, templ.content, result);
+    if (pattern.size() > 1) {
+        for (auto const& result : match(pattern.get_content())) {
+            apply_bindings_to_templ(target, templ.get_content(), result);
+        }
+        return;
+    }
+    MatchCursor cursor(*this, pattern.get_atom(0));
+    Bindings result;
+    while (cursor.next(result)) {
+        apply_bindings_to_templ(target, templ.get_content(), result);
+    }
+}
+
+// Conjunctive match
+
+static bool is_ground(AtomPtr const& atom) {
+    switch (atom->get_type()) {
+        case Atom::VARIABLE:
+            return false;
+        case Atom::EXPR:
+            for (auto const& child : std::static_pointer_cast<ExprAtom>(atom)->get_children()) {
+                if (!is_ground(child)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+void collect_variables(AtomPtr const& atom, std::vector<VariableAtomPtr>& vars) {
+    switch (atom->get_type()) {
+        case Atom::VARIABLE:
+            {
+                VariableAtomPtr var = std::static_pointer_cast<VariableAtom>(atom);
+                for (auto const& other : vars) {
+                    if (*other == *var) {
+                        return;
+                    }
+                }
+                vars.push_back(var);
+                return;
+            }
+        case Atom::EXPR:
+            for (auto const& child : std::static_pointer_cast<ExprAtom>(atom)->get_children()) {
+                collect_variables(child, vars);
+            }
+            return;
+        default:
+            return;
+    }
+}
+
+// Partial result of conjunctive match: bindings and positions of the atoms
+// matched by each clause
+struct JoinRow {
+    Bindings bindings;
+    std::vector<size_t> positions;
+};
+
+struct JoinKeyHash {
+    size_t operator()(std::vector<AtomPtr> const& key) const {
+        size_t hash = 0;
+        for (auto const& atom : key) {
+            hash = hash_combine(hash, atom->hash());
+        }
+        return hash;
+    }
+};
+
+struct JoinKeyEqual {
+    bool operator()(std::vector<AtomPtr> const& a, std::vector<AtomPtr> const& b) const {
+        return a == b;
+    }
+};
+
+static std::vector<AtomPtr> join_key(Bindings& bindings,
+        std::vector<VariableAtomPtr> const& vars) {
+    std::vector<AtomPtr> key;
+    key.reserve(vars.size());
+    for (auto const& var : vars) {
+        key.push_back(bindings[var]);
+    }
+    return key;
+}
+
+// Orders clauses greedily: each next clause shares variables with already
+// selected ones when possible and has the least number of index candidates
+static std::vector<size_t> plan_conjunction(std::vector<AtomPtr> const& clauses,
+        std::vector<std::vector<VariableAtomPtr>> const& vars,
+        std::vector<size_t> const& estimates) {
+    std::vector<size_t> order;
+    std::vector<bool> selected(clauses.size(), false);
+    std::vector<VariableAtomPtr> bound;
+    while (order.size() < clauses.size()) {
+        int best = -1;
+        bool best_shared = false;
+        for (size_t i = 0; i < clauses.size(); ++i) {
+            if (selected[i]) {
+                continue;
+            }
+            bool shared = false;
+            for (auto const& var : vars[i]) {
+                for (auto const& other : bound) {
+                    shared = shared || *var == *other;
+                }
+            }
+            if (best == -1 || (shared && !best_shared) ||
+                    (shared == best_shared && estimates[i] < estimates[best])) {
+                best = i;
+                best_shared = shared;
+            }
+        }
+        selected[best] = true;
+        order.push_back(best);
+        for (auto const& var : vars[best]) {
+            collect_variables(var, bound);
+        }
+    }
+    return order;
+}
+
+// Joins clauses in the planned order using hash joins on shared variables.
+// Returns false when the space contains non ground matching atoms or bindings:
+// in such case join is not equivalent to matching clauses one by one.
+static bool hash_join(GroundingSpace const& space, std::vector<AtomPtr> const& clauses,
+        std::vector<std::vector<VariableAtomPtr>> const& vars,
+        std::vector<size_t> const& order, std::vector<JoinRow>& rows) {
+    rows.assign(1, { Bindings(), std::vector<size_t>(clauses.size()) });
+    std::vector<VariableAtomPtr> bound;
+    for (size_t clause : order) {
+        std::vector<VariableAtomPtr> shared;
+        for (auto const& var : vars[clause]) {
+            for (auto const& other : bound) {
+                if (*var == *other) {
+                    shared.push_back(var);
+                }
+            }
+        }
+        std::unordered_map<std::vector<AtomPtr>, std::vector<size_t>,
+            JoinKeyHash, JoinKeyEqual> table;
+        std::vector<std::pair<size_t, Bindings>> matches;
+        MatchCursor cursor = space.match_cursor(clauses[clause]);
+        Bindings bindings;
+        while (cursor.next(bindings)) {
+            if (!is_ground(space.get_atom(cursor.get_position()))) {
+                return false;
+            }
+            table[join_key(bindings, shared)].push_back(matches.size());
+            matches.emplace_back(cursor.get_position(), std::move(bindings));
+        }
+        std::vector<JoinRow> joined;
+        for (auto& row : rows) {
+            auto it = table.find(join_key(row.bindings, shared));
+            if (it == table.end()) {
+                continue;
+            }
+            for (size_t i : it->second) {
+                JoinRow next = row;
+                for (auto const& pair : matches[i].second) {
+                    next.bindings[pair.first] = pair.second;
+                }
+                next.positions[clause] = matches[i].first;
+                joined.push_back(std::move(next));
+            }
+        }
+        rows = std::move(joined);
+        for (auto const& var : vars[clause]) {
+            collect_variables(var, bound);
+        }
     }
+    std::sort(rows.begin(), rows.end(), [](JoinRow const& a, JoinRow const& b) -> bool {
+                return a.positions < b.positions;
+            });
+    return true;
+}
+
+std::vector<Bindings> GroundingSpace::match(std::vector<AtomPtr> const& clauses) const {
+    TRACE_SCOPE("match");
+    Stats::Timer timer(Stats::MATCH_LATENCY);
+    std::vector<std::vector<VariableAtomPtr>> vars(clauses.size());
+    std::vector<size_t> estimates;
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        collect_variables(clauses[i], vars[i]);
+        AtomIndex::Candidates candidates = this->candidates(clauses[i], false);
+        size_t estimate = 0;
+        for (auto const& list : candidates.lists) {
+            estimate += list->size();
+        }
+        estimates.push_back(candidates.all ? content_size : estimate);
+    }
+    std::vector<size_t> order = plan_conjunction(clauses, vars, estimates);
+
+    std::vector<Bindings> results;
+    std::vector<JoinRow> rows;
+    if (hash_join(*this, clauses, vars, order, rows)) {
+        for (auto& row : rows) {
+            results.push_back(std::move(row.bindings));
+        }
+        return results;
+    }
+
+    LOG_DEBUG << "match clauses one by one" << std::endl;
+    results.emplace_back();
+    for (auto const& clause : clauses) {
+        std::vector<Bindings> next;
+        for (auto const& prev : results) {
+            MatchCursor cursor(*this, apply_bindings_to_atom(clause, prev));
+            Bindings bindings;
+            while (cursor.next(bindings)) {
+                Bindings merged = bindings;
+                for (auto const& pair : prev) {
+                    merged[pair.first] = apply_bindings_to_atom(pair.second, bindings);
+                }
+                next.push_back(std::move(merged));
+            }
+        }
+        results = std::move(next);
+    }
+    return results;
 }
 
 // Unify
 
 // FIXME: depth - is a hack for implementing unification with (= a b)
 // correctly; it should not be implemented here but on the caller level to keep
-// unify_atoms code clean
-bool unify_atoms(AtomPtr a, AtomPtr b, UnificationResult& result, int depth=0) {
+// unify_atoms code clean. Atoms of different shapes are not unified at depth
+// 0, AtomIndex::unify_candidates() relies on it.
+struct UnifyBindings {
+    BindingStore a_bindings;
+    BindingStore b_bindings;
+    Unifications unifications;
+    std::deque<AtomPtr> fresh;
+
+    void clear() {
+        a_bindings.clear();
+        b_bindings.clear();
+        unifications.clear();
+        fresh.clear();
+    }
+};
+
+// Variable which is used by interpreter to get the value of the function
+// call from the (= (f args...) $X) unification, it is unique so it cannot
+// clash with variables of the program
+VariableAtomPtr const RESULT = VariableAtom::unique("X");
+
+static bool unify_atoms(AtomPtr const& a, AtomPtr const& b, UnifyBindings& result, int depth=0) {
     // TODO: it is not clear how should we handle the case when a and b are
     // both variables. We can check variable name equality and skip binding. We
     // can add a as binding for b and vice versa.
     if (b->get_type() == Atom::VARIABLE) {
-        // FIXME: hardcoding V("X") below is a hack to make work matching for
+        // RESULT is not bound back to make work matching for
         // (= (plus Z $y) $y) and (= (plus Z $n) $X), otherwise $y cannot be
         // bound to $n and $X at same time, but bounding it to $X doesn't make
         // sense anyway
-        if (a->get_type() == Atom::VARIABLE && *b != *V("X")) {
-            return add_binding(result.a_bindings, a, b)
-                && add_binding(result.b_bindings, b, a);
+        if (a->get_type() == Atom::VARIABLE && *b != *RESULT) {
+            return result.a_bindings.add(a, b)
+                && result.b_bindings.add(b, a);
         } else {
-            return add_binding(result.b_bindings, b, a);
+            return result.b_bindings.add(b, a);
         }
     }
     switch (a->get_type()) {
@@ -215,16 +1439,19 @@ bool unify_atoms(AtomPtr a, AtomPtr b, UnificationResult& result, int depth=0) {
         if (b->get_type() == Atom::SYMBOL || b->get_type() == Atom::GROUNDED) {
             return *a == *b;
         }
+        if (depth == 0) {
+            return false;
+        }
         result.unifications.emplace_back(a, b);
         return true;
     case Atom::VARIABLE:
-        return add_binding(result.a_bindings, a, b);
+        return result.a_bindings.add(a, b);
     case Atom::EXPR:
         if (b->get_type() == Atom::EXPR) {
             ExprAtomPtr expr_a = std::static_pointer_cast<ExprAtom>(a);
             ExprAtomPtr expr_b = std::static_pointer_cast<ExprAtom>(b);
             if (expr_a->get_children().size() != expr_b->get_children().size()) {
-                if (depth == 1) {
+                if (depth <= 1) {
                     return false;
                 }
                 result.unifications.emplace_back(a, b);
@@ -236,6 +1463,9 @@ bool unify_atoms(AtomPtr a, AtomPtr b, UnificationResult& result, int depth=0) {
                 }
             }
         } else {
+            if (depth == 0) {
+                return false;
+            }
             result.unifications.emplace_back(a, b);
         }
         return true;
@@ -245,218 +1475,104 @@ bool unify_atoms(AtomPtr a, AtomPtr b, UnificationResult& result, int depth=0) {
     }
 }
 
-static void apply_bindings_to_unifications(UnificationResult& result) {
+static Unifications apply_bindings_to_unifications(UnifyBindings const& bindings,
+        RenamingBindings const& a_bindings, Bindings const& b_bindings) {
     Unifications applied;
-    for (const auto& unification : result.unifications) {
-        AtomPtr a = apply_bindings_to_atom(unification.a, result.a_bindings);
-        AtomPtr b = apply_bindings_to_atom(unification.b, result.b_bindings);
+    for (const auto& unification : bindings.unifications) {
+        AtomPtr a = apply_bindings_to_atom(unification.a, a_bindings);
+        AtomPtr b = apply_bindings_to_atom(unification.b, b_bindings);
         applied.emplace_back(a, b);
     }
-    result.unifications = applied;
+    return applied;
 }
 
 std::vector<UnificationResult> GroundingSpace::unify(AtomPtr atom) const {
+    TRACE_SCOPE("unify");
     LOG_DEBUG << "match and unify atom: " << atom->to_string() << std::endl;
     std::vector<UnificationResult> all_unifications;
-    for (auto const& candidate : get_content()) {
+    UnifyBindings bindings;
+    RuleMachine machine;
+    AtomIndex::Iterator it(candidates(atom, true), content_size);
+    size_t position;
+    size_t scanned = 0;
+    while (it.next(position)) {
+        if (is_removed(position)) {
+            continue;
+        }
+        ++scanned;
+        AtomPtr const& candidate = get_atom(position);
+        ProfileScope profile(candidate, position);
         UnificationResult result;
-        if (!unify_atoms(candidate, atom, result)) {
+        CompiledRule const* compiled = rules_compiled ?
+            storage->compiled[position].get() : nullptr;
+        if (compiled) {
+            if (!machine.unify(*compiled, atom, result)) {
+                LOG_TRACE << "candidate: " << candidate->to_string() << ": fail" << std::endl;
+                continue;
+            }
+            LOG_DEBUG << "candidate: " << candidate->to_string() << ": ok" << std::endl;
+            all_unifications.push_back(std::move(result));
+            profile.set_results(1);
+            continue;
+        }
+        bindings.clear();
+        if (!unify_atoms(candidate, atom, bindings)) {
             LOG_TRACE << "candidate: " << candidate->to_string() << ": fail" << std::endl;
             continue;
         }
         LOG_DEBUG << "candidate: " << candidate->to_string() << ": ok" << std::endl;
-        result.b_bindings = apply_bindings_to_bindings(result.a_bindings,
-                result.b_bindings);
-        apply_bindings_to_unifications(result);
-        all_unifications.push_back(result);
+        // variables of the candidate which are left unbound are
+        // renamed apart from the variables of the atom
+        RenamingBindings a_bindings{ bindings.a_bindings, bindings.fresh };
+        result.b_bindings = apply_bindings_to_bindings(a_bindings,
+                bindings.b_bindings);
+        result.unifications = apply_bindings_to_unifications(bindings,
+                a_bindings, result.b_bindings);
+        all_unifications.push_back(std::move(result));
+        profile.set_results(1);
     }
+    counters->queries.fetch_add(1, std::memory_order_relaxed);
+    counters->candidates_scanned.fetch_add(scanned, std::memory_order_relaxed);
+    counters->candidates_matched.fetch_add(all_unifications.size(), std::memory_order_relaxed);
+    Stats::add(Stats::CANDIDATES_SCANNED, scanned);
+    Stats::add(Stats::CANDIDATES_MATCHED, all_unifications.size());
+    Stats::add(Stats::BINDINGS_CREATED, all_unifications.size());
     return all_unifications; 
 }
 
 // Interpret
 
-struct SubExpression {
-    static int NO_PARENT;
-    SubExpression(ExprAtomPtr expr, int parent_sub_index, int child_index)
-        : expr(expr) , parent_sub_index(parent_sub_index), child_index(child_index) { }
-    bool has_parent() const { return parent_sub_index != NO_PARENT; }
-    ExprAtomPtr expr;
-    int parent_sub_index;
-    int child_index;
-};
-
-int SubExpression::NO_PARENT = -1; 
-class ExpressionReduction : public GroundedAtom {
-public:
-
-    ExpressionReduction(GroundingSpace const& kb, ExprAtomPtr expr)
-        : kb(kb) { parse(expr, SubExpression::NO_PARENT, 0); }
-    ExpressionReduction(GroundingSpace const& kb, ExprAtomPtr full,
-            std::vector<SubExpression> subs)
-        : kb(kb), subs(subs) {}
-
-    void execute(GroundingSpace const& args, GroundingSpace& result) const override;
-
-    bool operator==(Atom const& _other) const override {
-        ExpressionReduction const* other = dynamic_cast<ExpressionReduction const*>(&_other);
-        return other && *full() == *(other->full());
-    }
-
-    std::string to_string() const override {
-        return "reduction " + full()->to_string();
-    }
-
-private:
-    void parse(ExprAtomPtr expr, int parent_sub_index, int child_index);
-    std::shared_ptr<ExpressionReduction> pop_sub(SubExpression sub, AtomPtr replacement) const;
-    ExprAtomPtr full() const { return subs[0].expr; }
-    void replace_sub(SubExpression& sub, AtomPtr replacement);
-
-    GroundingSpace const& kb;
-    std::vector<SubExpression> subs;
-};
-
-void ExpressionReduction::parse(ExprAtomPtr expr, int parent_sub_index, int child_index) {
-    int expr_sub_index = subs.size();
-    subs.emplace_back(expr, parent_sub_index, child_index);
-    auto const& children = expr->get_children();
-    for (int i = 0; i < children.size(); ++i) {
-        AtomPtr child = children[i];
-        if (child->get_type() == Atom::EXPR) {
-            parse(std::static_pointer_cast<ExprAtom>(child), expr_sub_index, i);
-        }
-    }
-}
-
-struct ExecutionResult {
-    bool success;
-    std::vector<AtomPtr> results;
-};
-
-static bool is_grounded_expression(ExprAtomPtr expr) {
+bool is_grounded_expression(ExprAtomPtr const& expr) {
     return expr->get_children()[0]->get_type() == Atom::GROUNDED;
 }
 
-static ExecutionResult execute_grounded_expression(ExprAtomPtr expr) {
+ExecutionResult execute_grounded_expression(ExprAtomPtr const& expr) {
+    TRACE_SCOPE("execute");
+    Stats::add(Stats::GROUNDED_CALLS);
     GroundedAtom const* func = static_cast<GroundedAtom const*>(expr->get_children()[0].get());
     // TODO: How should we return results of the execution? At the moment they
     // are put into current atomspace. Should we return new child atomspace
     // instead?
-    auto children = expr->get_children();
-    GroundingSpace args(children);
-    LOG_DEBUG << "args: \"" << args.to_string() << "\"" << std::endl;
-    GroundingSpace results;
+    LOG_DEBUG << "args: \"" << expr->to_string() << "\"" << std::endl;
+    ExecutionResult result{ true, std::vector<AtomPtr>() };
+    AtomVectorSink sink(result.results);
+    ProfileScope profile(expr->get_children()[0]);
     try {
-        func->execute(args, results);
+        func->execute(AtomSpan(expr->get_children()), sink);
     } catch (...) {
         // FIXME: we should print the error here, but for doing this we need to
         // add new type for error; this is the case for
         // IllegalArgumentExpression analogue
         LOG_DEBUG << "error while executing expression" << std::endl;
-        return { true, std::vector<AtomPtr>() };
-    }
-    LOG_DEBUG << "results: \"" << results.to_string() << "\"" << std::endl;
-    return { true, results.get_content() };
-}
-
-static AtomPtr match_plain_nongrounded_expression(GroundingSpace const& kb, ExprAtomPtr expr, AtomPtr templ, GroundingSpace& target) {
-    LOG_DEBUG << "looking for expression in KB: " << expr->to_string() << std::endl;
-    std::vector<Bindings> results = kb.match(E({ S("="), expr, V("X") }));
-    std::vector<AtomPtr> _templ({ templ });
-    for (auto const& result : results) {
-        apply_bindings_to_templ(target, _templ, result);
-    }
-    return results.empty() ? expr : Atom::INVALID;
-}
-
-static AtomPtr interpret_full_expression(GroundingSpace const& kb, ExprAtomPtr expr, GroundingSpace& target) {
-    if (is_grounded_expression(expr)) {
-        ExecutionResult result = execute_grounded_expression(expr);
-        if (result.success) {
-            for (auto const& result : result.results) {
-                target.add_atom(result);
-            }
-            return Atom::INVALID;
-        } else {
-            return expr;
-        }
-    } else {
-        return match_plain_nongrounded_expression(kb, expr, V("X"), target);
-    }
-}
-
-void ExpressionReduction::execute(GroundingSpace const& args, GroundingSpace& target) const {
-    SubExpression const& sub = subs.back();
-    if (!sub.has_parent()) {
-        LOG_DEBUG << "full expression: " << sub.expr->to_string() << std::endl;
-        AtomPtr non_interpretable = interpret_full_expression(kb, sub.expr, target);
-        if (non_interpretable) {
-            target.add_atom(non_interpretable);
-        }
-    } else {
-        LOG_DEBUG << "sub expression: " << sub.expr->to_string() << std::endl;
-        if (is_grounded_expression(sub.expr)) {
-            ExecutionResult result = execute_grounded_expression(sub.expr);
-            if (result.success) {
-                if (result.results.empty()) {
-                    throw std::runtime_error("Grounded expression: " +
-                            sub.expr->to_string() +
-                            " returned nothing while being part of large expression: " +
-                            full()->to_string());
-                }
-                for (auto const& result : result.results) {
-                    target.add_atom(E({ pop_sub(sub, result) }));
-                }
-            } else {
-                target.add_atom(E({ pop_sub(sub, Atom::INVALID) }));
-            }
-        } else {
-            GroundingSpace results;
-            // FIXME: hack temporary replace expr by variable to form pattern
-            subs[sub.parent_sub_index].expr->get_children()[sub.child_index] = V("X");
-            AtomPtr non_interpretable = match_plain_nongrounded_expression(kb, sub.expr, full(), results);
-            subs[sub.parent_sub_index].expr->get_children()[sub.child_index] = sub.expr;
-            if (non_interpretable) {
-                target.add_atom(E({ pop_sub(sub, Atom::INVALID) }));
-                return;
-            }
-            for (auto const& result : results.get_content()) {
-                ExprAtomPtr expr = std::static_pointer_cast<ExprAtom>(result);
-                // FIXME: ineffective we parse expression each time even if
-                // no variables were replaced
-                target.add_atom(E({std::make_shared<ExpressionReduction>(kb, expr)}));
-            }   
-        }
-    }
-}
-
-void ExpressionReduction::replace_sub(SubExpression& sub, AtomPtr replacement) {
-    SubExpression& parent_sub = subs[sub.parent_sub_index];
-    ExprAtomPtr parent_copy = E(parent_sub.expr->get_children());  
-    parent_copy->get_children()[sub.child_index] = replacement;
-    if (parent_sub.has_parent()) {
-        subs[sub.parent_sub_index].expr->get_children()[sub.child_index] = replacement;
+        result.results.clear();
+        return result;
     }
-    parent_sub.expr = parent_copy;
-}
-
-std::shared_ptr<ExpressionReduction> ExpressionReduction::pop_sub(SubExpression sub, AtomPtr tail) const {
-    // TODO: replace copy by reusing array with variable containing size
-    std::vector<SubExpression> subs_copy = subs;
-    subs_copy.pop_back();
-    auto copy = std::make_shared<ExpressionReduction>(kb, full(), subs_copy);
-    if (tail) {
-        copy->replace_sub(sub, tail);
-        if (tail->get_type() == Atom::EXPR) {
-            ExprAtomPtr expr = std::static_pointer_cast<ExprAtom>(tail);
-            copy->parse(expr, sub.parent_sub_index, sub.child_index);
-            return copy;
-        }
-    }
-    return copy;
+    LOG_DEBUG << "results: \"" << ::to_string(result.results, ", ") << "\"" << std::endl;
+    profile.set_results(result.results.size());
+    return result;
 }
 
-static bool is_plain_expression(ExprAtomPtr expr) {
+bool is_plain_expression(ExprAtomPtr const& expr) {
     for (auto const& child : expr->get_children()) {
         if (child->get_type() == Atom::EXPR) {
             return false;
@@ -470,13 +1586,10 @@ public:
     IfMatchAtom() {}
     virtual ~IfMatchAtom() {}
 
-    void execute(GroundingSpace const& args, GroundingSpace& result) const override {
-        AtomPtr a = args.get_content()[1];
-        AtomPtr b = args.get_content()[2];
+    void execute(AtomSpan args, AtomSink& result) const override {
         MatchBindings match;
-        if (match_atoms(a, b, match)) {
-            AtomPtr c = args.get_content()[3];
-            c = apply_bindings_to_atom(c, match.a_bindings);
+        if (match_atoms(args[1], args[2], match)) {
+            AtomPtr c = apply_bindings_to_atom(args[3], match.a_bindings);
             c = apply_bindings_to_atom(c, match.b_bindings);
             result.add_atom(c);
         }
@@ -488,9 +1601,10 @@ public:
 
 const GroundedAtomPtr IFMATCH = std::make_shared<IfMatchAtom>();
 
-const SymbolAtomPtr REDUCT = S("reduct");
-// FIXME: make AT symbol more unique
-const SymbolAtomPtr AT = S("@");
+// REDUCT and AT are not interned, so they cannot be confused with "reduct"
+// and "@" symbols from the interpreted program
+const SymbolAtomPtr REDUCT = std::make_shared<SymbolAtom>(SymbolTable::instance().unique("reduct"));
+const SymbolAtomPtr AT = std::make_shared<SymbolAtom>(SymbolTable::instance().unique("@"));
 
 static bool find_next_expr(std::vector<AtomPtr>::iterator& it,
         std::vector<AtomPtr>::const_iterator end) {
@@ -547,12 +1661,33 @@ static AtomPtr generate_if_eq_recursively(Unifications::const_reverse_iterator i
 }
 
 static AtomPtr unification_result_to_expr(UnificationResult const& unification_result,
-        VariableAtomPtr var) {
+        VariableAtomPtr const& var) {
     auto value = unification_result.b_bindings.at(var);
     auto it = unification_result.unifications.crbegin();
     return generate_if_eq_recursively(it, unification_result.unifications.crend(), value);
 }
 
+// Copies of EQUAL and RESULT owned by the thread, threads which interpret
+// expressions using the same knowledge base don't contend on reference
+// counters of the shared atoms
+static thread_local AtomPtr const THREAD_EQUAL = std::make_shared<SymbolAtom>(
+        static_cast<SymbolAtom const&>(*EQUAL).get_id());
+static thread_local AtomPtr const THREAD_RESULT = std::make_shared<VariableAtom>(*RESULT);
+
+std::vector<UnificationResult> unify_function_call(GroundingSpace const& kb,
+        ExprAtomPtr const& expr) {
+    return kb.unify(E({THREAD_EQUAL, expr, THREAD_RESULT}));
+}
+
+AtomPtr function_call_result(UnificationResult const& result) {
+    TRACE_SCOPE("apply_rule");
+    auto value = result.b_bindings.find(RESULT);
+    if (value == result.b_bindings.end()) {
+        throw std::runtime_error("No value for " + RESULT->to_string() + " var");
+    }
+    return unification_result_to_expr(result, RESULT);
+}
+
 static AtomPtr interpret_expr_step(GroundingSpace const& kb,
     AtomPtr atom, bool reducted, std::function<void(AtomPtr, Bindings const*)> callback) {
     LOG_DEBUG << "interpreting atom: " << atom->to_string() << std::endl;
@@ -610,9 +1745,7 @@ static AtomPtr interpret_expr_step(GroundingSpace const& kb,
         }
     } else {
         LOG_DEBUG << "interpreting symbolic expression" << std::endl;
-        // FIXME: replace V("X") by UniqueVar
-        VariableAtomPtr var = V("X");
-        std::vector<UnificationResult> results = kb.unify(E({S("="), expr, var}));
+        std::vector<UnificationResult> results = unify_function_call(kb, expr);
         if (results.empty()) {
             LOG_DEBUG << "unification is not found" << std::endl;
             if (is_plain_expression(expr) || reducted) {
@@ -627,43 +1760,137 @@ static AtomPtr interpret_expr_step(GroundingSpace const& kb,
         } else {
             LOG_DEBUG << "adding unification results" << std::endl; 
             for (auto const& result : results) {
-                auto value = result.b_bindings.find(var);
-                if (value != result.b_bindings.end()) {
-                    callback(unification_result_to_expr(result, var), &result.b_bindings);
-                } else {
-                    throw std::runtime_error("No value for " + var->to_string() + " var");
-                }
+                callback(function_call_result(result), &result.b_bindings);
             }
             return Atom::INVALID;
         }
     }
 }
 
+AtomPtr const EOS = S("eos");
+
 AtomPtr GroundingSpace::interpret_step(SpaceAPI const& _kb) {
+    TRACE_SCOPE("interpret_step");
+    Stats::add(Stats::INTERPRETER_STEPS);
     if (_kb.get_type() != GroundingSpace::TYPE) {
         throw std::runtime_error("Only " + GroundingSpace::TYPE +
                 " knowledge bases are supported");
     }
     GroundingSpace const& kb = static_cast<GroundingSpace const&>(_kb);
 
-    if (content.empty()) {
-        return S("eos");
+    if (size() == 0) {
+        return EOS;
     }
 
-    AtomPtr atom = content.back();
-    content.pop_back();
+    AtomPtr atom = pop_atom();
     LOG_DEBUG << "next atom: " << atom->to_string() << std::endl;
-    return interpret_expr_step(kb, atom, false, [this](AtomPtr result, Bindings const* bindings) -> void {
+    return interpret_expr_step(kb, atom, false, [this](AtomPtr result, Bindings const*) -> void {
                 LOG_DEBUG << "push atom: " << result->to_string() << std::endl;
-                this->content.push_back(result);
+                this->add_atom(result);
             });
 }
 
+// Position of the branch in the tree of the nondeterministic evaluation,
+// index is the order in which interpret_step() visits siblings
+struct BranchPath {
+    std::shared_ptr<BranchPath const> parent;
+    size_t index;
+};
+
+using BranchPathPtr = std::shared_ptr<BranchPath const>;
+
+static std::vector<size_t> branch_path_to_vector(BranchPathPtr path) {
+    std::vector<size_t> result;
+    for (; path; path = path->parent) {
+        result.push_back(path->index);
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+struct ParallelInterpreter {
+    GroundingSpace const& kb;
+    bool deterministic;
+    WorkStealingPool pool;
+    std::mutex results_mutex;
+    std::vector<std::pair<BranchPathPtr, AtomPtr>> results;
+
+    ParallelInterpreter(GroundingSpace const& kb, size_t threads, bool deterministic)
+        : kb(kb), deterministic(deterministic), pool(threads) { }
+
+    void submit(AtomPtr atom, BranchPathPtr path) {
+        pool.submit([this, atom, path]() -> void { interpret(atom, path); });
+    }
+
+    void interpret(AtomPtr const& atom, BranchPathPtr const& path) {
+        Stats::add(Stats::INTERPRETER_STEPS);
+        LOG_DEBUG << "next atom: " << atom->to_string() << std::endl;
+        std::vector<AtomPtr> branches;
+        AtomPtr result = interpret_expr_step(kb, atom, false,
+                [&branches](AtomPtr result, Bindings const*) -> void {
+                    branches.push_back(result);
+                });
+        if (result) {
+            std::lock_guard<std::mutex> lock(results_mutex);
+            results.emplace_back(path, result);
+            return;
+        }
+        // interpret_step() visits the last added branch first
+        for (size_t i = 0; i < branches.size(); ++i) {
+            BranchPathPtr branch;
+            if (deterministic) {
+                branch = std::make_shared<BranchPath const>(BranchPath{ path, branches.size() - 1 - i });
+            }
+            submit(branches[i], branch);
+        }
+    }
+};
+
+std::vector<AtomPtr> GroundingSpace::interpret_parallel(SpaceAPI const& _kb,
+        size_t threads, bool deterministic) {
+    if (_kb.get_type() != GroundingSpace::TYPE) {
+        throw std::runtime_error("Only " + GroundingSpace::TYPE +
+                " knowledge bases are supported");
+    }
+    GroundingSpace const& kb = static_cast<GroundingSpace const&>(_kb);
+    if (&kb == this) {
+        throw std::logic_error("Space cannot be interpreted using itself as knowledge base");
+    }
+
+    ParallelInterpreter interpreter(kb, threads, deterministic);
+    for (size_t i = 0; size() > 0; ++i) {
+        AtomPtr atom = pop_atom();
+        interpreter.submit(atom, deterministic ?
+                std::make_shared<BranchPath const>(BranchPath{ nullptr, i }) : nullptr);
+    }
+    interpreter.pool.run();
+
+    if (deterministic) {
+        std::vector<std::pair<std::vector<size_t>, AtomPtr>> sorted;
+        for (auto const& result : interpreter.results) {
+            sorted.emplace_back(branch_path_to_vector(result.first), result.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) -> bool {
+                    return a.first < b.first;
+                });
+        std::vector<AtomPtr> results;
+        for (auto& result : sorted) {
+            results.push_back(std::move(result.second));
+        }
+        return results;
+    }
+    std::vector<AtomPtr> results;
+    for (auto& result : interpreter.results) {
+        results.push_back(std::move(result.second));
+    }
+    return results;
+}
+
 bool GroundingSpace::operator==(SpaceAPI const& _other) const {
     if (_other.get_type() != GroundingSpace::TYPE) {
         return false;
     }
     GroundingSpace const& other = static_cast<GroundingSpace const&>(_other);
-    return content == other.content;
+    return get_content() == other.get_content();
 }
 
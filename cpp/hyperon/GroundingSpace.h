@@ -6,8 +6,19 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <limits>
 
 #include "SpaceAPI.h"
+#include "stats.h"
 
 // Atom
 
@@ -26,39 +37,84 @@ public:
 
     static AtomPtr INVALID;
 
+    Atom() { Stats::addAtom(); }
     virtual ~Atom() { }
     virtual Type get_type() const = 0;
     virtual bool operator==(Atom const& other) const = 0;
     virtual bool operator!=(Atom const& other) const { return !(*this == other); }
     virtual std::string to_string() const = 0;
+    // Equal atoms should have equal hashes, default implementation returns
+    // the same hash for all atoms of the same type
+    virtual size_t hash() const { return std::hash<int>()(get_type()); }
 };
 
+inline size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
 std::string to_string(Atom::Type type);
 bool operator==(std::vector<AtomPtr> const& a, std::vector<AtomPtr> const& b); 
 std::string to_string(std::vector<AtomPtr> const& atoms, std::string delimiter);
 
+// Symbol table
+
+class SymbolAtom;
+
+using SymbolAtomPtr = std::shared_ptr<SymbolAtom>;
+using SymbolId = uint32_t;
+
+// Process wide table of symbol names. Each name is stored once and gets a
+// dense id, S() returns the same atom instance for the same name. Table is
+// thread safe and never shrinks, so references to names stay valid.
+class SymbolTable {
+public:
+    static SymbolTable& instance();
+    // Separate table of variable names keeps variable ids dense
+    static SymbolTable& variables();
+
+    SymbolId intern(std::string_view name);
+    // Allocates new id which is never returned by intern(), it is used to
+    // create symbols which cannot be confused with symbols parsed from text
+    SymbolId unique(std::string_view name);
+    std::string const& get_name(SymbolId id) const;
+    SymbolAtomPtr get_atom(std::string_view name);
+    size_t size() const;
+
+private:
+    SymbolTable() { }
+    SymbolId add_name(std::string_view name);
+
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::vector<SymbolAtomPtr> atoms;
+};
+
 // Symbol atom
 
 class SymbolAtom : public Atom {
 public:
-    SymbolAtom(std::string symbol) : symbol(symbol) { }
+    SymbolAtom(std::string const& symbol) : SymbolAtom(SymbolTable::instance().intern(symbol)) { }
+    SymbolAtom(SymbolId id) : id(id), symbol(&SymbolTable::instance().get_name(id)) { }
     virtual ~SymbolAtom() { }
-    std::string get_symbol() const { return symbol; }
+    std::string const& get_symbol() const { return *symbol; }
+    SymbolId get_id() const { return id; }
 
     Type get_type() const override { return SYMBOL; }
     bool operator==(Atom const& _other) const override { 
-        SymbolAtom const* other = dynamic_cast<SymbolAtom const*>(&_other);
-        return other && symbol == other->symbol;
+        return _other.get_type() == SYMBOL &&
+            static_cast<SymbolAtom const&>(_other).id == id;
     }
-    std::string to_string() const override { return symbol; }
+    bool operator<(SymbolAtom const& other) const { return id < other.id; }
+    std::string to_string() const override { return *symbol; }
+    size_t hash() const override { return hash_combine(SYMBOL, id); }
 private:
-    std::string symbol;
+    SymbolId id;
+    std::string const* symbol;
 };
 
-using SymbolAtomPtr = std::shared_ptr<SymbolAtom>;
-
-inline auto S(std::string symbol) {
-    return std::make_shared<SymbolAtom>(symbol);
+inline SymbolAtomPtr S(std::string const& symbol) {
+    return SymbolTable::instance().get_atom(symbol);
 }
 
 // Expression atom
@@ -66,47 +122,116 @@ inline auto S(std::string symbol) {
 class ExprAtom : public Atom {
 public:
     ExprAtom(std::initializer_list<AtomPtr> children) : children(children) { }
-    ExprAtom(std::vector<AtomPtr> children) : children(children) { }
+    ExprAtom(std::vector<AtomPtr> children) : children(std::move(children)) { }
     virtual ~ExprAtom() { }
-    std::vector<AtomPtr>& get_children() { return children; }
+    std::vector<AtomPtr> const& get_children() const { return children; }
+    void set_child(size_t index, AtomPtr child);
+    // Frozen expression and its subexpressions cannot be modified, frozen
+    // expression calculates its hash once
+    void freeze();
+    bool is_frozen() const { return frozen; }
 
     Type get_type() const override { return EXPR; }
     bool operator==(Atom const& _other) const override;
     std::string to_string() const override { return "(" + ::to_string(children, " ") + ")"; }
+    size_t hash() const override { return frozen ? hash_value : calculate_hash(children); }
 
 private:
+    friend class ExprTable;
+
+    static size_t calculate_hash(std::vector<AtomPtr> const& children);
+
     std::vector<AtomPtr> children;
+    bool frozen = false;
+    // canonical expression is an instance returned by ExprTable
+    bool canonical = false;
+    size_t hash_value = 0;
 };
 
 using ExprAtomPtr = std::shared_ptr<ExprAtom>;
 
-inline auto E(std::initializer_list<AtomPtr> children) {
-    return std::make_shared<ExprAtom>(children);
+// Hash consing table for expressions. It is disabled by default, when it is
+// enabled E() returns the same frozen instance for structurally equal
+// expressions. Equality of two such instances is a pointer comparison.
+// Table keeps weak references only, expression is removed from the table
+// when the last reference to it is released. Table is split into shards by
+// hash, each shard has its own lock.
+class ExprTable {
+public:
+    static ExprTable& instance();
+
+    void set_enabled(bool enabled) { this->enabled = enabled; }
+    bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+    ExprAtomPtr intern(std::vector<AtomPtr> children);
+    size_t size() const;
+
+private:
+    struct Entry {
+        ExprAtom const* expr;
+        std::weak_ptr<ExprAtom> ref;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_multimap<size_t, Entry> exprs;
+    };
+
+    static const size_t SHARDS = 64;
+
+    ExprTable() { }
+    Shard& get_shard(size_t hash) { return shards[hash % SHARDS]; }
+    void release(size_t hash);
+
+    std::atomic<bool> enabled{false};
+    Shard shards[SHARDS];
+};
+
+inline ExprAtomPtr E(std::vector<AtomPtr> children) {
+    if (ExprTable::instance().is_enabled()) {
+        return ExprTable::instance().intern(std::move(children));
+    }
+    return std::make_shared<ExprAtom>(std::move(children));
 }
 
-inline auto E(std::vector<AtomPtr> children) {
-    return std::make_shared<ExprAtom>(children);
+inline ExprAtomPtr E(std::initializer_list<AtomPtr> children) {
+    return E(std::vector<AtomPtr>(children));
 }
 
 // Variable atom
 
+class VariableAtom;
+
+using VariableAtomPtr = std::shared_ptr<VariableAtom>;
+// Ids of named variables are ids of their names in SymbolTable::variables(),
+// ids of unique variables are allocated above them
+using VariableId = uint64_t;
+
 class VariableAtom : public Atom {
 public:
-    VariableAtom(std::string name) : name(name) { }
+    VariableAtom(std::string const& name) : VariableAtom(SymbolTable::variables().intern(name)) { }
+    VariableAtom(SymbolId id) : VariableAtom(id, &SymbolTable::variables().get_name(id)) { }
     virtual ~VariableAtom() { }
-    std::string get_name() const { return name; }
+    std::string const& get_name() const { return *name; }
+    VariableId get_id() const { return id; }
+    // Returns new variable with the same name which is not equal to any
+    // other variable, it is used to rename variables of the rule apart from
+    // variables of the query
+    VariableAtomPtr fresh() const;
+    static VariableAtomPtr unique(std::string const& name);
 
     Type get_type() const override { return VARIABLE; }
     bool operator==(Atom const& _other) const override {
-        VariableAtom const* other = dynamic_cast<VariableAtom const*>(&_other);
-        return other && name == other->name;
+        return _other.get_type() == VARIABLE &&
+            static_cast<VariableAtom const&>(_other).id == id;
     }
-    std::string to_string() const override { return "$" + name; }
+    std::string to_string() const override { return "$" + *name; }
+    size_t hash() const override { return hash_combine(VARIABLE, id); }
 private:
-    std::string name;
-};
+    VariableAtom(VariableId id, std::string const* name) : id(id), name(name) { }
 
-using VariableAtomPtr = std::shared_ptr<VariableAtom>;
+    VariableId id;
+    std::string const* name;
+};
 
 inline auto V(std::string name) {
     return std::make_shared<VariableAtom>(name);
@@ -115,7 +240,7 @@ inline auto V(std::string name) {
 class LessVariableAtomPtr {
 public:
     bool operator()(VariableAtomPtr const& a, VariableAtomPtr const& b) const {
-        return a->get_name() < b->get_name();
+        return a->get_id() < b->get_id();
     }
 };
 
@@ -125,12 +250,48 @@ using Bindings = std::map<VariableAtomPtr, AtomPtr, LessVariableAtomPtr>;
 
 class GroundingSpace;
 
+// Non owning view of the atoms of the grounded expression, args[0] is the
+// grounded atom itself and args[1...] are arguments
+class AtomSpan {
+public:
+    AtomSpan(AtomPtr const* data, size_t size) : data(data), length(size) { }
+    AtomSpan(std::vector<AtomPtr> const& atoms) : data(atoms.data()), length(atoms.size()) { }
+
+    AtomPtr const& operator[](size_t index) const { return data[index]; }
+    size_t size() const { return length; }
+    AtomPtr const* begin() const { return data; }
+    AtomPtr const* end() const { return data + length; }
+
+private:
+    AtomPtr const* data;
+    size_t length;
+};
+
+// Receives results of the grounded expression execution
+class AtomSink {
+public:
+    virtual ~AtomSink() { }
+    virtual void add_atom(AtomPtr atom) = 0;
+};
+
+class AtomVectorSink : public AtomSink {
+public:
+    AtomVectorSink(std::vector<AtomPtr>& atoms) : atoms(atoms) { }
+    virtual ~AtomVectorSink() { }
+    void add_atom(AtomPtr atom) override { atoms.push_back(std::move(atom)); }
+private:
+    std::vector<AtomPtr>& atoms;
+};
+
+// Grounded atom should override one of the execute() methods. The
+// AtomSpan/AtomSink one is called by interpreter and doesn't allocate
+// spaces for arguments and results, the GroundingSpace one is kept for
+// compatibility. Each of them by default calls the other one.
 class GroundedAtom : public Atom {
 public:
     virtual ~GroundedAtom() { }
-    virtual void execute(GroundingSpace const& args, GroundingSpace& result) const {
-        throw std::runtime_error("Operation is not supported");
-    }
+    virtual void execute(AtomSpan args, AtomSink& result) const;
+    virtual void execute(GroundingSpace const& args, GroundingSpace& result) const;
 
     Type get_type() const override { return GROUNDED; }
 };
@@ -163,20 +324,206 @@ struct Unification {
 using Unifications = std::vector<Unification>;
 
 struct UnificationResult {
-    // FIXME: a_bindings can be removed from here
-    Bindings a_bindings;
     Bindings b_bindings;
     Unifications unifications;
 };
 
+// Index of GroundingSpace content. Expressions are indexed by arity and
+// head atom, symbols and grounded atoms are indexed by themselves. Index
+// returns positions of atoms which can match a pattern, pattern which has
+// variable or expression as a head cannot be looked up and requires full
+// scan.
+class AtomIndex {
+public:
+    using Positions = std::vector<size_t>;
+
+    // Sorted lists of positions of candidates, all == true means that
+    // whole content should be scanned. When ends is not empty positions of
+    // lists[i] which are not less than ends[i] are not candidates.
+    struct Candidates {
+        bool all = false;
+        std::vector<Positions const*> lists;
+        std::vector<size_t> ends;
+    };
+
+    // Merges lists of candidates to iterate over them in order of content
+    class Iterator {
+    public:
+        Iterator(Candidates candidates, size_t size);
+        bool next(size_t& position);
+    private:
+        Candidates candidates;
+        std::vector<size_t> next_positions;
+        size_t size;
+    };
+
+    void add(AtomPtr const& atom, size_t position);
+    // Removes atom from index, atom should be the last one added
+    void remove_last(AtomPtr const& atom, size_t position);
+    Candidates match_candidates(AtomPtr const& pattern) const;
+    Candidates unify_candidates(AtomPtr const& atom) const;
+
+private:
+    // arity == NOT_EXPR is used to index symbols and grounded atoms
+    static const size_t NOT_EXPR;
+
+    struct Key {
+        size_t arity;
+        AtomPtr atom;
+    };
+    struct KeyHash {
+        size_t operator()(Key const& key) const { return hash_combine(key.arity, key.atom->hash()); }
+    };
+    struct KeyEqual {
+        bool operator()(Key const& a, Key const& b) const { return a.arity == b.arity && *a.atom == *b.atom; }
+    };
+
+    struct AtomHash {
+        size_t operator()(AtomPtr const& atom) const { return atom->hash(); }
+    };
+    struct AtomEqual {
+        bool operator()(AtomPtr const& a, AtomPtr const& b) const { return *a == *b; }
+    };
+
+    // Index of the function clauses by the value of a single argument,
+    // others keeps clauses which can be unified with any constant value
+    struct ArgIndex {
+        std::unordered_map<AtomPtr, Positions, AtomHash, AtomEqual> constants;
+        Positions others;
+    };
+
+    // Clauses (= (f args...) body) of a single function, argument indexes
+    // are built on demand when caller passes a constant in argument
+    // position (just in time indexing). Index is built under lock and
+    // published atomically, so concurrent readers can use it.
+    struct Function {
+        Function(size_t arity) : arity(arity), arg_indexes(new std::atomic<ArgIndex*>[arity]()) { }
+        Function(Function const&) = delete;
+        ~Function();
+
+        size_t arity;
+        Positions clauses;
+        std::vector<ExprAtomPtr> calls;
+        std::unique_ptr<std::atomic<ArgIndex*>[]> arg_indexes;
+    };
+
+    Positions* find_positions(AtomPtr const& atom);
+    static Positions& arg_positions(ArgIndex& index, AtomPtr const& arg);
+    static ArgIndex const& get_arg_index(Function const& function, size_t arg);
+    Candidates candidates(AtomPtr const& pattern, bool expression_heads) const;
+    bool rule_candidates(AtomPtr const& pattern, Candidates& candidates) const;
+    void add_list(Candidates& candidates, std::unordered_map<size_t, Positions> const& lists, size_t arity) const;
+
+    std::unordered_map<Key, Positions, KeyHash, KeyEqual> atoms;
+    std::unordered_map<size_t, Positions> variable_heads;
+    std::unordered_map<size_t, Positions> expression_heads;
+    Positions variables;
+
+    // Rule table: (= (f args...) body) clauses by function, other (= a b)
+    // atoms are kept in generic_rules
+    std::unordered_map<Key, Function, KeyHash, KeyEqual> functions;
+    Positions generic_rules;
+};
+
+struct MatchBindings;
+class CompiledRule;
+
+class MatchCursor;
+
+// Vector which never moves its elements. Elements are kept in chunks of
+// doubling size, chunk is allocated when the first element is appended to
+// it. Elements below the size can be read from other threads while
+// push_back() appends new ones, other modifications need exclusive access.
+template <typename T>
+class ChunkedVector {
+public:
+    ChunkedVector() { }
+    ChunkedVector(ChunkedVector const&) = delete;
+    ChunkedVector& operator=(ChunkedVector const&) = delete;
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    T& operator[](size_t index) { return element(index); }
+    T const& operator[](size_t index) const { return element(index); }
+    T& back() { return element(size() - 1); }
+
+    void push_back(T value) {
+        size_t index = count.load(std::memory_order_relaxed);
+        size_t chunk = chunk_of(index);
+        if (!chunks[chunk]) {
+            chunks[chunk].reset(new T[FIRST_CHUNK << chunk]);
+        }
+        chunks[chunk][index - chunk_begin(chunk)] = std::move(value);
+        count.store(index + 1, std::memory_order_release);
+    }
+    void pop_back() {
+        size_t index = count.load(std::memory_order_relaxed) - 1;
+        element(index) = T();
+        count.store(index, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t FIRST_CHUNK = 16;
+    static constexpr size_t MAX_CHUNKS = 48;
+
+    // Chunk i keeps elements from FIRST_CHUNK * (2^i - 1) up to the next
+    // chunk
+    static size_t chunk_of(size_t index) {
+        unsigned long long n = index / FIRST_CHUNK + 1;
+#ifdef __GNUC__
+        return 63 - __builtin_clzll(n);
+#else
+        size_t chunk = 0;
+        while (n >>= 1) {
+            ++chunk;
+        }
+        return chunk;
+#endif
+    }
+    static size_t chunk_begin(size_t chunk) {
+        return FIRST_CHUNK * ((size_t(1) << chunk) - 1);
+    }
+    T& element(size_t index) const {
+        size_t chunk = chunk_of(index);
+        return chunks[chunk][index - chunk_begin(chunk)];
+    }
+
+    std::unique_ptr<T[]> chunks[MAX_CHUNKS];
+    std::atomic<size_t> count{0};
+};
+
+// Const methods of the space (match, unify, interpretation using the space
+// as a knowledge base) can be called from many threads at once while the
+// space is not modified.
+//
+// To query the space while it is modified readers use versions of the
+// space: publish() makes an immutable version which contains atoms added
+// so far, snapshot() returns the last published version and can be called
+// from any thread while writer adds atoms and publishes new versions.
+// Version shares atoms and index with the space: atoms are appended in
+// place and index of new atoms is kept in a separate segment, so publishing
+// doesn't copy the content. Version is released when the last reader drops
+// it.
 class GroundingSpace : public SpaceAPI {
 public:
 
     static std::string TYPE;
 
-    GroundingSpace() { }
-    GroundingSpace(std::initializer_list<AtomPtr> content) : content(content) { }
-    GroundingSpace(std::vector<AtomPtr> content) : content(content) { }
+    GroundingSpace() : storage(std::make_shared<Storage>()),
+        segments({ { std::make_shared<AtomIndex>(), 0, 0 } }),
+        counters(std::make_shared<Counters>()) { }
+    GroundingSpace(std::initializer_list<AtomPtr> content) : GroundingSpace() {
+        for (auto const& atom : content) {
+            add_atom(atom);
+        }
+    }
+    GroundingSpace(std::vector<AtomPtr> const& content) : GroundingSpace() {
+        for (auto const& atom : content) {
+            add_atom(atom);
+        }
+    }
+    GroundingSpace(GroundingSpace const&) = delete;
+    GroundingSpace(GroundingSpace&&) = default;
 
     virtual ~GroundingSpace() { }
 
@@ -186,9 +533,33 @@ public:
 
     std::string get_type() const override { return TYPE; }
 
-    void add_atom(AtomPtr atom) {
-        content.push_back(atom);
-    }
+    void add_atom(AtomPtr atom);
+    // Removes the first occurrence of the atom, returns false when atom is
+    // not found. Removed atoms are marked and skipped by queries, content is
+    // compacted when more than half of it is removed.
+    bool remove_atom(AtomPtr atom);
+    // Removes the atom and adds the replacement to the end of the content,
+    // returns false and doesn't add replacement when atom is not found
+    bool replace_atom(AtomPtr atom, AtomPtr replacement);
+    // Removes all atoms matching the pattern, returns the number of removed
+    // atoms
+    size_t remove_matching(AtomPtr pattern);
+
+    // Makes atoms added so far visible to the readers of snapshot()
+    void publish();
+    // Returns the version made by the last publish() call or empty space
+    // when nothing is published yet
+    std::shared_ptr<GroundingSpace const> snapshot() const;
+    // Makes an immutable version which contains current content of the
+    // space without publishing it. The version is not changed when the
+    // space is modified or compacted, so it can be used as a knowledge base
+    // while the space is changed.
+    std::shared_ptr<GroundingSpace const> view();
+
+    // Compiles (= head body) rules of the space into the code of abstract
+    // machine which unify() runs instead of walking rule atoms. Rules added
+    // after the call are compiled by add_atom().
+    void compile_rules();
 
     // TODO: Which operations should we add into SpaceAPI to make
     // interpret_step space implementation agnostic?
@@ -196,23 +567,173 @@ public:
     // will input and return SpaceAPI then interpret_step could be implemented
     // on a SpaceAPI level.
     AtomPtr interpret_step(SpaceAPI const& kb);
+    // Interprets all atoms of the space until each branch of the
+    // nondeterministic evaluation returns a result or fails, branches are
+    // interpreted in parallel using given number of threads (0 means number
+    // of cores). Interpreted atoms are removed from the space. When
+    // deterministic is true results are returned in the same order as
+    // interpret_step() returns them, otherwise in order of completion.
+    // Knowledge base is read by many threads, so it should not be modified
+    // until the call returns, pass view() of it to modify it concurrently.
+    std::vector<AtomPtr> interpret_parallel(SpaceAPI const& kb,
+            size_t threads = 0, bool deterministic = true);
     // TODO: Discuss moving into SpaceAPI as match_to replacement
     std::vector<Bindings> match(AtomPtr pattern) const;
+    // Returns no more than limit first results of match(pattern)
+    std::vector<Bindings> match(AtomPtr pattern, size_t limit) const;
+    // Matches conjunction of clauses, results and their order are the same as
+    // if clauses were matched one by one in the order given, applying
+    // bindings of each result to the next clause
+    std::vector<Bindings> match(std::vector<AtomPtr> const& clauses) const;
+    MatchCursor match_cursor(AtomPtr pattern) const;
+    bool exists(AtomPtr pattern) const;
+    size_t count(AtomPtr pattern) const;
     // FIXME: this method can be removed and implemented in client code on top
     // of GroundingSpace::match
     void match(SpaceAPI const& pattern, SpaceAPI const& templ, GroundingSpace& space) const;
     std::vector<UnificationResult> unify(AtomPtr atom) const;
-    std::vector<AtomPtr> const& get_content() const { return content; }
+    // Returns a copy of the atoms which are not removed. The copy is owned
+    // by the caller, so it stays valid and unchanged when the space is
+    // modified later.
+    std::vector<AtomPtr> get_content() const;
+    size_t size() const { return content_size - removed_count; }
+    SpaceStats get_stats() const;
+    // Returns atom by position returned by MatchCursor, position of the
+    // atom is changed when content is compacted
+    AtomPtr const& get_atom(size_t position) const { return storage->content[position]; }
 
     bool operator==(SpaceAPI const& space) const;
     bool operator!=(SpaceAPI const& other) const { return !(*this == other); }
-    std::string to_string() const { return "<" + ::to_string(content, ", ") + ">"; }
+    std::string to_string() const { return "<" + ::to_string(get_content(), ", ") + ">"; }
 
 private:
+    friend class MatchCursor;
+    friend class AnswerTable;
+
+    // Number of the publication after which the atom is removed, 0 when atom
+    // is not removed. It is atomic because writer removes atoms while
+    // published versions read the storage.
+    struct Removal {
+        Removal() { }
+        Removal(Removal const& other) : epoch(other.epoch.load(std::memory_order_relaxed)) { }
+        Removal& operator=(Removal const& other) {
+            epoch.store(other.epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        std::atomic<size_t> epoch{0};
+    };
+    // Atoms and compiled rules by position. Atoms are appended in place
+    // while storage is shared with published versions, each version reads
+    // the positions below its own size only. Storage is copied before
+    // other modifications when it is shared.
+    struct Storage {
+        ChunkedVector<AtomPtr> content;
+        // Compiled rules by position in content, nullptr for other atoms
+        ChunkedVector<std::shared_ptr<CompiledRule const>> compiled;
+        ChunkedVector<Removal> removed;
+    };
+    // Index of the content starting from begin up to the next segment. The
+    // last segment is modified by add_atom() and pop_position() while it is
+    // not shared with versions or cursors. Shared index is not modified, so
+    // it keeps positions popped from the content until the segment is
+    // merged, queries skip positions beyond the segment.
+    struct Segment {
+        std::shared_ptr<AtomIndex> index;
+        size_t begin;
+        // end of the positions kept in index
+        size_t end;
+    };
+    // Query statistics shared with published versions
+    struct Counters {
+        std::atomic<uint64_t> queries{0};
+        std::atomic<uint64_t> candidates_scanned{0};
+        std::atomic<uint64_t> candidates_matched{0};
+    };
+
+    GroundingSpace(GroundingSpace const& space, size_t segments);
+
+    AtomPtr pop_atom();
+    bool pop_position();
+    void compile_rule(AtomPtr const& atom);
+    // Atoms removed after this publication are not visible to the space
+    size_t visible_epoch() const {
+        return is_version ? epoch : std::numeric_limits<size_t>::max();
+    }
+    bool is_removed(size_t position) const {
+        size_t removed = storage->removed[position].epoch.load(std::memory_order_relaxed);
+        return removed != 0 && removed <= visible_epoch();
+    }
+    // Storage and index segments are shared with versions and cursors by
+    // reference counting, shared ones are not modified in place
+    bool storage_shared() const { return storage.use_count() > 1; }
+    void seal_segment();
+    void remove_position(size_t position);
+    void compact();
+    void detach_storage();
+    void merge_segments();
+    AtomIndex::Candidates candidates(AtomPtr const& atom, bool unify) const;
+    void for_each_candidate(AtomIndex::Candidates const& candidates,
+            std::function<void(AtomPtr const&)> visit) const;
+
+    std::shared_ptr<Storage> storage;
+    // Number of positions in storage including removed atoms
+    size_t content_size = 0;
+    size_t removed_count = 0;
+    // Used by AnswerTable to find out that rules are removed or positions
+    // of atoms are changed
+    size_t rule_removals = 0;
+    size_t compactions = 0;
+    // Number of the next publication, it marks atoms removed by writer.
+    // Version keeps the number of its publication.
+    size_t epoch = 1;
+    std::vector<Segment> segments;
+    bool rules_compiled = false;
+    std::shared_ptr<GroundingSpace const> version;
+    bool is_version = false;
+    std::shared_ptr<Counters> counters;
+};
+
+// Lazily iterates over results of GroundingSpace::match(pattern). Cursor
+// shares the storage and the index of the space, which are not modified in
+// place while they are shared, so the space can be changed and compacted
+// while cursor is used. Atoms added after cursor is created are not
+// visited, atoms removed after it can be visited or skipped.
+class MatchCursor {
+public:
+    MatchCursor(GroundingSpace const& space, AtomPtr pattern);
+    MatchCursor(MatchCursor&& other);
+    ~MatchCursor();
+
+    // Moves to the next matching atom and returns its bindings
+    bool next(Bindings& bindings);
+    // Moves to the next matching atom without building its bindings
+    bool next();
+    // Returns position of the current matching atom in the space content
+    // at the moment cursor is created
+    size_t get_position() const { return position; }
 
-    std::vector<AtomPtr> content;
+private:
+    bool is_removed(size_t position) const;
+
+    std::shared_ptr<GroundingSpace::Storage const> storage;
+    std::vector<std::shared_ptr<AtomIndex const>> indexes;
+    std::shared_ptr<GroundingSpace::Counters> counters;
+    // Atoms removed after this publication are visible to the cursor
+    size_t visible_epoch;
+    AtomPtr pattern;
+    AtomIndex::Iterator candidates;
+    size_t position;
+    std::unique_ptr<MatchBindings> bindings;
+    // Added to the statistics when cursor is destroyed
+    size_t scanned = 0;
+    size_t matched = 0;
+    size_t bound = 0;
 };
 
+inline MatchCursor GroundingSpace::match_cursor(AtomPtr pattern) const {
+    return MatchCursor(*this, pattern);
+}
+
 // TODO: think how to export it properly: either we should export API to
 // implement it and move it into common library or we should consider it to be
 // a part of the GroundingSpace API
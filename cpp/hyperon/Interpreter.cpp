@@ -0,0 +1,403 @@
+#include "Interpreter.h"
+
+#include "logger_priv.h"
+#include "tracer_priv.h"
+#include "interpreter_priv.h"
+
+// Answer table
+
+bool AnswerTable::is_tabled(ExprAtomPtr const& call) const {
+    return !heads.empty() && !call->get_children().empty()
+        && heads.count(call->get_children()[0]);
+}
+
+VariableAtomPtr const& AnswerTable::canonical_variable(size_t index) {
+    while (canonical.size() <= index) {
+        canonical.push_back(VariableAtom::unique("_" + std::to_string(canonical.size())));
+    }
+    return canonical[index];
+}
+
+void AnswerTable::clear() {
+    entries.clear();
+    lru.clear();
+    answer_count = 0;
+    ++generation;
+}
+
+void AnswerTable::erase(std::unordered_map<AtomPtr, Entry, AtomHash, AtomEqual>::iterator it) {
+    if (it->second.complete) {
+        answer_count -= it->second.answers.size();
+        lru.erase(it->second.lru);
+    }
+    entries.erase(it);
+}
+
+void AnswerTable::invalidate(AtomPtr const& head) {
+    LOG_DEBUG << "invalidate answers of " << head->to_string() << std::endl;
+    for (auto it = entries.begin(); it != entries.end(); ) {
+        auto next = std::next(it);
+        if (*std::static_pointer_cast<ExprAtom>(it->first)->get_children()[0] == *head) {
+            erase(it);
+        }
+        it = next;
+    }
+    ++generation;
+}
+
+// Looks at the atoms added to the knowledge base after the previous call
+// and invalidates answers of the functions whose rules were added
+void AnswerTable::sync(GroundingSpace const& kb) {
+    static AtomPtr const EQUAL = S("=");
+    if (this->kb != &kb || kb.content_size < kb_size
+            || kb.rule_removals != kb_rule_removals || kb.compactions != kb_compactions) {
+        clear();
+        this->kb = &kb;
+        kb_size = kb.content_size;
+        kb_rule_removals = kb.rule_removals;
+        kb_compactions = kb.compactions;
+        return;
+    }
+    for (; kb_size < kb.content_size; ++kb_size) {
+        AtomPtr const& atom = kb.get_atom(kb_size);
+        if (atom->get_type() != Atom::EXPR) {
+            continue;
+        }
+        auto const& rule = std::static_pointer_cast<ExprAtom>(atom)->get_children();
+        if (rule.size() != 3 || *rule[0] != *EQUAL) {
+            continue;
+        }
+        AtomPtr const& call = rule[1];
+        if (call->get_type() != Atom::EXPR) {
+            continue;
+        }
+        auto const& children = std::static_pointer_cast<ExprAtom>(call)->get_children();
+        if (children.empty() || children[0]->get_type() == Atom::VARIABLE
+                || children[0]->get_type() == Atom::EXPR) {
+            clear();
+        } else if (heads.count(children[0])) {
+            invalidate(children[0]);
+        }
+    }
+}
+
+AnswerTable::Entry* AnswerTable::find(AtomPtr const& key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return nullptr;
+    }
+    if (it->second.complete) {
+        lru.splice(lru.begin(), lru, it->second.lru);
+    }
+    return &it->second;
+}
+
+void AnswerTable::start(AtomPtr const& key) {
+    entries.emplace(key, Entry{ false, {}, lru.end() });
+}
+
+void AnswerTable::complete(AtomPtr const& key, size_t generation,
+        std::vector<AtomPtr>&& answers) {
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second.complete) {
+        return;
+    }
+    if (generation != this->generation || answers.size() > max_answers) {
+        entries.erase(it);
+        return;
+    }
+    LOG_DEBUG << "answers of " << key->to_string() << ": " <<
+        ::to_string(answers, ", ") << std::endl;
+    while (answer_count + answers.size() > max_answers) {
+        erase(entries.find(lru.back()));
+    }
+    answer_count += answers.size();
+    it->second.complete = true;
+    it->second.answers = std::move(answers);
+    it->second.lru = lru.insert(lru.begin(), key);
+}
+
+void AnswerTable::abort(AtomPtr const& key) {
+    auto it = entries.find(key);
+    if (it != entries.end() && !it->second.complete) {
+        entries.erase(it);
+    }
+}
+
+// Interpreter
+
+struct Interpreter::Frame {
+    // Children of the expression, value of the evaluated argument is
+    // written into children[arg]. Frame of the tabled call has no argument
+    // and keeps variables of the call as children.
+    std::vector<AtomPtr> children;
+    size_t arg;
+    FramePtr parent;
+    std::shared_ptr<Recorder> recorder;
+};
+
+static size_t const NO_ARG = static_cast<size_t>(-1);
+
+// Collects answers of the tabled call, answers are put into the table when
+// the last frame of the call and the task which returns answers to the
+// caller are released, i.e. evaluation of the call is finished
+struct Interpreter::Recorder {
+    Recorder(Interpreter const& interpreter, AtomPtr key, Bindings canonical,
+            std::vector<VariableAtomPtr> const& vars)
+        : interpreter(interpreter), key(key), canonical(std::move(canonical)),
+        vars(vars), generation(interpreter.table->generation) { }
+    ~Recorder() {
+        if (interpreter.closing) {
+            interpreter.table->abort(key);
+        } else {
+            interpreter.table->complete(key, generation, std::move(answers));
+        }
+    }
+
+    void add_answer(AtomPtr const& value, std::vector<AtomPtr> const& vars) {
+        std::vector<AtomPtr> children;
+        children.reserve(vars.size() + 1);
+        children.push_back(value);
+        children.insert(children.end(), vars.begin(), vars.end());
+        answers.push_back(apply_bindings_to_atom(E(std::move(children)), canonical));
+    }
+
+    Interpreter const& interpreter;
+    AtomPtr key;
+    Bindings canonical;
+    // variables of the call in order of canonical variables
+    std::vector<VariableAtomPtr> vars;
+    size_t generation;
+    std::vector<AtomPtr> answers;
+};
+
+static size_t find_next_expr(std::vector<AtomPtr> const& children, size_t i) {
+    while (i < children.size() && children[i]->get_type() != Atom::EXPR) {
+        ++i;
+    }
+    return i;
+}
+
+// Replaces canonical variables of the answer by the variables of the call
+// and renames other variables apart
+static AtomPtr instantiate_answer(AtomPtr const& atom, Bindings& names) {
+    switch (atom->get_type()) {
+        case Atom::VARIABLE:
+            {
+                VariableAtomPtr var = std::static_pointer_cast<VariableAtom>(atom);
+                auto it = names.find(var);
+                if (it == names.end()) {
+                    it = names.emplace(var, var->fresh()).first;
+                }
+                return it->second;
+            }
+        case Atom::EXPR:
+            {
+                auto const& children = std::static_pointer_cast<ExprAtom>(atom)->get_children();
+                std::vector<AtomPtr> instance;
+                instance.reserve(children.size());
+                for (auto const& child : children) {
+                    instance.push_back(instantiate_answer(child, names));
+                }
+                return E(std::move(instance));
+            }
+        default:
+            return atom;
+    }
+}
+
+Interpreter::~Interpreter() {
+    closing = true;
+    tasks.clear();
+}
+
+void Interpreter::add_atom(AtomPtr atom) {
+    tasks.push_back({ atom, nullptr, false });
+}
+
+// Returns false when answers of the call are taken from the table or the
+// call is scheduled. Frames of the call which is not in the table are
+// pushed above the task which returns recorded answers to the caller, so
+// the call is evaluated to the end first and recursion of tabled calls
+// doesn't use the C++ stack. Call which is being evaluated already
+// (recursive call of the same variant) or which answers are not kept is
+// evaluated without table.
+bool Interpreter::tabled_call(Task& task, ExprAtomPtr const& expr) {
+    table->sync(kb);
+    std::vector<VariableAtomPtr> vars;
+    collect_variables(expr, vars);
+    Bindings canonical;
+    for (size_t i = 0; i < vars.size(); ++i) {
+        canonical[vars[i]] = table->canonical_variable(i);
+    }
+    AtomPtr key = apply_bindings_to_atom(expr, canonical);
+    AnswerTable::Entry* entry = table->find(key);
+    if (!entry) {
+        LOG_DEBUG << "evaluating tabled call: " << key->to_string() << std::endl;
+        table->start(key);
+        auto recorder = std::make_shared<Recorder>(*this, key, std::move(canonical), vars);
+        FramePtr frame = std::make_shared<Frame>(Frame{
+                std::vector<AtomPtr>(vars.begin(), vars.end()), NO_ARG,
+                nullptr, recorder });
+        tasks.push_back({ expr, std::move(task.parent), false, false, std::move(recorder) });
+        tasks.push_back({ expr, std::move(frame), task.reducted });
+        return false;
+    }
+    if (entry->complete) {
+        LOG_DEBUG << "answers are found in table" << std::endl;
+        return_answers(entry->answers, vars, task.parent);
+        return false;
+    }
+    return true;
+}
+
+// Pushes values of the answers to the parent binding variables of the call,
+// the first answer is interpreted first
+void Interpreter::return_answers(std::vector<AtomPtr> const& answers,
+        std::vector<VariableAtomPtr> const& vars, FramePtr const& parent) {
+    for (auto it = answers.rbegin(); it != answers.rend(); ++it) {
+        Bindings names;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            names[table->canonical_variable(i)] = vars[i];
+        }
+        AtomPtr answer = instantiate_answer(*it, names);
+        auto const& values = std::static_pointer_cast<ExprAtom>(answer)->get_children();
+        Bindings bindings;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            if (*values[i + 1] != *vars[i]) {
+                bindings[vars[i]] = values[i + 1];
+            }
+        }
+        FramePtr applied = parent && !bindings.empty()
+            ? apply_bindings(parent, bindings) : parent;
+        tasks.push_back({ values[0], std::move(applied), false, true });
+    }
+}
+
+void Interpreter::evaluate_arg(Task&& task, ExprAtomPtr const& expr, size_t arg) {
+    LOG_DEBUG << "reducting expression" << std::endl;
+    AtomPtr const& child = expr->get_children()[arg];
+    FramePtr frame = std::make_shared<Frame>(
+            Frame{ expr->get_children(), arg, std::move(task.parent), nullptr });
+    tasks.push_back({ child, std::move(frame), false });
+}
+
+void Interpreter::return_value(AtomPtr const& value, FramePtr&& parent) {
+    if (parent.use_count() > 1) {
+        parent = std::make_shared<Frame>(*parent);
+    }
+    std::vector<AtomPtr>& children = parent->children;
+    children[parent->arg] = value;
+    bool ifmatch = children[0] == IFMATCH;
+    size_t next = find_next_expr(children, parent->arg + 1);
+    if (next < children.size() && (!ifmatch || next <= 2)) {
+        parent->arg = next;
+        AtomPtr const& child = children[next];
+        tasks.push_back({ child, std::move(parent), false });
+    } else {
+        LOG_DEBUG << "interpreting expression after reduction" << std::endl;
+        tasks.push_back({ E(std::move(children)), std::move(parent->parent), true });
+    }
+}
+
+// Value of the tabled call is recorded only, it is returned to the caller
+// by the task of the call when all answers are recorded
+AtomPtr Interpreter::return_result(AtomPtr const& value, FramePtr&& parent) {
+    if (parent && parent->recorder) {
+        parent->recorder->add_answer(value, parent->children);
+        return Atom::INVALID;
+    }
+    if (!parent) {
+        return value;
+    }
+    return_value(value, std::move(parent));
+    return Atom::INVALID;
+}
+
+Interpreter::FramePtr Interpreter::apply_bindings(FramePtr const& frame,
+        Bindings const& bindings) {
+    FramePtr parent = frame->parent ? apply_bindings(frame->parent, bindings) : nullptr;
+    FramePtr copy;
+    for (size_t i = 0; i < frame->children.size(); ++i) {
+        if (i == frame->arg) {
+            continue;
+        }
+        AtomPtr applied = apply_bindings_to_atom(frame->children[i], bindings);
+        if (applied != frame->children[i]) {
+            if (!copy) {
+                copy = std::make_shared<Frame>(*frame);
+            }
+            copy->children[i] = applied;
+        }
+    }
+    if (!copy) {
+        if (parent == frame->parent) {
+            return frame;
+        }
+        copy = std::make_shared<Frame>(*frame);
+    }
+    copy->parent = std::move(parent);
+    return copy;
+}
+
+AtomPtr Interpreter::step() {
+    TRACE_SCOPE("interpret_step");
+    Stats::add(Stats::INTERPRETER_STEPS);
+    if (tasks.empty()) {
+        return EOS;
+    }
+    Task task = std::move(tasks.back());
+    tasks.pop_back();
+    LOG_DEBUG << "interpreting atom: " << task.atom->to_string() << std::endl;
+
+    if (task.call) {
+        LOG_DEBUG << "returning answers of tabled call" << std::endl;
+        return_answers(task.call->answers, task.call->vars, task.parent);
+        return Atom::INVALID;
+    }
+    if (task.evaluated || task.atom->get_type() != Atom::EXPR) {
+        return return_result(task.atom, std::move(task.parent));
+    }
+    ExprAtomPtr expr = std::static_pointer_cast<ExprAtom>(task.atom);
+    if (is_grounded_expression(expr)) {
+        if (is_plain_expression(expr) || task.reducted) {
+            LOG_DEBUG << "executing grounded expression" << std::endl;
+            ExecutionResult result = execute_grounded_expression(expr);
+            if (!result.success) {
+                LOG_DEBUG << "cannot execute expression" << std::endl;
+                return return_result(expr, std::move(task.parent));
+            }
+            for (auto const& result : result.results) {
+                tasks.push_back({ result, task.parent, false });
+            }
+        } else {
+            evaluate_arg(std::move(task), expr, find_next_expr(expr->get_children(), 0));
+        }
+        return Atom::INVALID;
+    }
+
+    LOG_DEBUG << "interpreting symbolic expression" << std::endl;
+    if (table && table->is_tabled(expr)) {
+        if (!is_plain_expression(expr) && !task.reducted) {
+            evaluate_arg(std::move(task), expr, find_next_expr(expr->get_children(), 0));
+            return Atom::INVALID;
+        }
+        if (!tabled_call(task, expr)) {
+            return Atom::INVALID;
+        }
+    }
+    std::vector<UnificationResult> results = unify_function_call(kb, expr);
+    if (results.empty()) {
+        if (is_plain_expression(expr) || task.reducted) {
+            LOG_DEBUG << "symbolic expression is not interpretable" << std::endl;
+            return return_result(expr, std::move(task.parent));
+        }
+        evaluate_arg(std::move(task), expr, find_next_expr(expr->get_children(), 0));
+        return Atom::INVALID;
+    }
+    for (auto const& result : results) {
+        FramePtr parent = task.parent ? apply_bindings(task.parent, result.b_bindings) : nullptr;
+        tasks.push_back({ function_call_result(result), std::move(parent), false });
+    }
+    return Atom::INVALID;
+}
@@ -0,0 +1,136 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "GroundingSpace.h"
+
+// Answers of the calls of tabled functions. Call is keyed by the expression
+// with variables renamed in order of occurrence, so calls which differ by
+// variable names only share answers. Answer keeps the value of the call
+// and values of the call's variables. Entries of the function are dropped
+// when its rules are added to the knowledge base, all entries are dropped
+// when rules are removed from the knowledge base, least recently used
+// entries are dropped when number of answers kept exceeds max_answers.
+// Table should be used by a single interpreter at a time.
+class AnswerTable {
+public:
+    AnswerTable(size_t max_answers = 1 << 16) : max_answers(max_answers) { }
+
+    // Marks function with the given head as tabled. Function should be
+    // pure: its answers should depend on the rules of the function only.
+    void add_head(AtomPtr head) { heads.insert(head); }
+    bool is_tabled(ExprAtomPtr const& call) const;
+    void clear();
+    // Number of calls answered
+    size_t size() const { return lru.size(); }
+    // Number of answers kept
+    size_t answers() const { return answer_count; }
+
+private:
+    friend class Interpreter;
+
+    struct AtomHash {
+        size_t operator()(AtomPtr const& atom) const { return atom->hash(); }
+    };
+    struct AtomEqual {
+        bool operator()(AtomPtr const& a, AtomPtr const& b) const { return *a == *b; }
+    };
+    struct Entry {
+        bool complete;
+        std::vector<AtomPtr> answers;
+        std::list<AtomPtr>::iterator lru;
+    };
+
+    VariableAtomPtr const& canonical_variable(size_t index);
+    void sync(GroundingSpace const& kb);
+    void invalidate(AtomPtr const& head);
+    Entry* find(AtomPtr const& key);
+    void start(AtomPtr const& key);
+    void complete(AtomPtr const& key, size_t generation, std::vector<AtomPtr>&& answers);
+    void abort(AtomPtr const& key);
+    void erase(std::unordered_map<AtomPtr, Entry, AtomHash, AtomEqual>::iterator it);
+
+    size_t max_answers;
+    size_t answer_count = 0;
+    std::unordered_set<AtomPtr, AtomHash, AtomEqual> heads;
+    std::unordered_map<AtomPtr, Entry, AtomHash, AtomEqual> entries;
+    // Keys of complete entries, most recently used first
+    std::list<AtomPtr> lru;
+    std::vector<VariableAtomPtr> canonical;
+    // Incremented when entries are invalidated, answers of the calls
+    // started before are not kept
+    size_t generation = 0;
+    GroundingSpace const* kb = nullptr;
+    size_t kb_size = 0;
+    size_t kb_rule_removals = 0;
+    size_t kb_compactions = 0;
+};
+
+// Interpreter which keeps the position of the argument being evaluated in a
+// stack of frames instead of rewriting whole expression on each step: a
+// frame keeps the children of the expression and index of the argument, the
+// argument's value is written into the parent frame when it is evaluated.
+// Frames are shared between nondeterministic branches and copied only when
+// one branch changes a frame which other branch still uses. Interpreter
+// returns the same results in the same order as
+// GroundingSpace::interpret_step() does.
+//
+// When answer table is passed, calls of the tabled functions are evaluated
+// once: arguments of such call are evaluated first, then frames of the call
+// are evaluated to the end before the caller is continued, its answers are
+// recorded into the table and returned in the same order as without table.
+// Later calls are answered from the table. Table should outlive the
+// interpreter.
+class Interpreter {
+public:
+    Interpreter(GroundingSpace const& kb, AnswerTable* table = nullptr)
+        : kb(kb), table(table) { }
+    // Tabled calls being evaluated refer to the interpreter
+    Interpreter(Interpreter const&) = delete;
+    ~Interpreter();
+
+    // Adds expression to interpret, the last added expression is
+    // interpreted first as in GroundingSpace
+    void add_atom(AtomPtr atom);
+    // Makes one step of interpretation. Returns the result when expression is
+    // fully interpreted, S("eos") when nothing is left to interpret and
+    // Atom::INVALID otherwise.
+    AtomPtr step();
+    bool empty() const { return tasks.empty(); }
+
+private:
+    struct Frame;
+    struct Recorder;
+    using FramePtr = std::shared_ptr<Frame>;
+
+    struct Task {
+        AtomPtr atom;
+        FramePtr parent;
+        bool reducted;
+        // atom is a value which is returned to parent as is
+        bool evaluated = false;
+        // tabled call whose answers are returned to parent, task is
+        // interpreted after all frames of the call are evaluated
+        std::shared_ptr<Recorder> call = nullptr;
+    };
+
+    void evaluate_arg(Task&& task, ExprAtomPtr const& expr, size_t arg);
+    bool tabled_call(Task& task, ExprAtomPtr const& expr);
+    void return_answers(std::vector<AtomPtr> const& answers,
+            std::vector<VariableAtomPtr> const& vars, FramePtr const& parent);
+    void return_value(AtomPtr const& value, FramePtr&& parent);
+    AtomPtr return_result(AtomPtr const& value, FramePtr&& parent);
+    static FramePtr apply_bindings(FramePtr const& frame, Bindings const& bindings);
+
+    GroundingSpace const& kb;
+    AnswerTable* table;
+    std::vector<Task> tasks;
+    bool closing = false;
+};
+
+#endif /* INTERPRETER_H */
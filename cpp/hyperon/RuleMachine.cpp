@@ -0,0 +1,219 @@
+#include "RuleMachine.h"
+
+#include <stdexcept>
+
+#include "interpreter_priv.h"
+
+// Compiled rule
+
+CompiledRule::CompiledRule(AtomPtr const& rule) {
+    compile(rule);
+}
+
+bool CompiledRule::compile(AtomPtr const& atom) {
+    size_t index = get.size();
+    get.push_back({ GET_CONST, atom, 0, 0, put.size(), 0, true });
+    bool ground = true;
+    switch (atom->get_type()) {
+        case Atom::SYMBOL:
+        case Atom::GROUNDED:
+            put.push_back({ PUT_CONST, atom, 0 });
+            break;
+        case Atom::VARIABLE:
+            {
+                VariableAtomPtr var = std::static_pointer_cast<VariableAtom>(atom);
+                size_t reg = 0;
+                while (reg < registers.size() && *registers[reg] != *var) {
+                    ++reg;
+                }
+                get[index].op = reg < registers.size() ? GET_VALUE : GET_VARIABLE;
+                get[index].arg = reg;
+                if (reg == registers.size()) {
+                    registers.push_back(var);
+                }
+                put.push_back({ PUT_VARIABLE, atom, reg });
+                ground = false;
+                break;
+            }
+        case Atom::EXPR:
+            {
+                auto const& children = std::static_pointer_cast<ExprAtom>(atom)->get_children();
+                get[index].op = GET_EXPR;
+                get[index].arg = children.size();
+                for (auto const& child : children) {
+                    ground = compile(child) && ground;
+                }
+                if (ground) {
+                    put.resize(get[index].put_begin);
+                    put.push_back({ PUT_CONST, atom, 0 });
+                } else {
+                    put.push_back({ PUT_EXPR, atom, children.size() });
+                }
+                break;
+            }
+        default:
+            throw std::logic_error("Not implemented for type: " +
+                    to_string(atom->get_type()));
+    }
+    get[index].end = get.size();
+    get[index].put_end = put.size();
+    get[index].ground = ground;
+    return ground;
+}
+
+// Rule machine
+
+bool RuleMachine::bind_register(size_t reg, AtomPtr const& value) {
+    if (!registers[reg]) {
+        registers[reg] = &value;
+        return true;
+    }
+    return **registers[reg] == *value;
+}
+
+bool RuleMachine::bind_variable(CompiledRule const& rule, AtomPtr const& var, size_t get) {
+    VariableId id = static_cast<VariableAtom const&>(*var).get_id();
+    for (auto const& binding : bindings) {
+        if (binding.id == id) {
+            return *rule.get[binding.get].atom == *rule.get[get].atom;
+        }
+    }
+    bindings.push_back({ id, &var, get });
+    return true;
+}
+
+// Unification rules are the same as in unify_atoms() from GroundingSpace.cpp:
+// depth is a number of expressions entered, atoms of different shapes are
+// not unified at depth 0, expressions of different arity are not unified at
+// depth 1, otherwise such atoms are added to unifications
+bool RuleMachine::run(CompiledRule const& rule, AtomPtr const& atom) {
+    registers.assign(rule.registers.size(), nullptr);
+    bindings.clear();
+    unifications.clear();
+    levels.clear();
+    size_t pc = 0;
+    while (pc < rule.get.size()) {
+        size_t depth = levels.size();
+        AtomPtr const& b = levels.empty() ? atom
+            : (*levels.back().children)[levels.back().next++];
+        CompiledRule::Get const& ins = rule.get[pc];
+        if (b->get_type() == Atom::VARIABLE) {
+            bool a_var = ins.op == CompiledRule::GET_VARIABLE
+                || ins.op == CompiledRule::GET_VALUE;
+            if (a_var && *b != *RESULT && !bind_register(ins.arg, b)) {
+                return false;
+            }
+            if (!bind_variable(rule, b, pc)) {
+                return false;
+            }
+            pc = ins.end;
+        } else {
+            switch (ins.op) {
+                case CompiledRule::GET_CONST:
+                    if (b->get_type() == Atom::EXPR) {
+                        if (depth == 0) {
+                            return false;
+                        }
+                        unifications.push_back({ pc, &b });
+                    } else if (*ins.atom != *b) {
+                        return false;
+                    }
+                    pc = ins.end;
+                    break;
+                case CompiledRule::GET_VARIABLE:
+                    registers[ins.arg] = &b;
+                    pc = ins.end;
+                    break;
+                case CompiledRule::GET_VALUE:
+                    if (!bind_register(ins.arg, b)) {
+                        return false;
+                    }
+                    pc = ins.end;
+                    break;
+                case CompiledRule::GET_EXPR:
+                    if (b->get_type() != Atom::EXPR) {
+                        if (depth == 0) {
+                            return false;
+                        }
+                        unifications.push_back({ pc, &b });
+                        pc = ins.end;
+                    } else {
+                        auto const& children = std::static_pointer_cast<ExprAtom>(b)->get_children();
+                        if (children.size() != ins.arg) {
+                            if (depth <= 1) {
+                                return false;
+                            }
+                            unifications.push_back({ pc, &b });
+                            pc = ins.end;
+                        } else {
+                            levels.push_back({ &children, 0 });
+                            ++pc;
+                        }
+                    }
+                    break;
+            }
+        }
+        while (!levels.empty() && levels.back().next == levels.back().children->size()) {
+            levels.pop_back();
+        }
+    }
+    return true;
+}
+
+AtomPtr const& RuleMachine::register_value(CompiledRule const& rule, size_t reg) {
+    if (!registers[reg]) {
+        // unbound variables of the rule are renamed apart
+        fresh.push_back(rule.registers[reg]->fresh());
+        registers[reg] = &fresh.back();
+    }
+    return *registers[reg];
+}
+
+AtomPtr RuleMachine::build(CompiledRule const& rule, size_t get) {
+    CompiledRule::Get const& ins = rule.get[get];
+    if (ins.ground) {
+        return ins.atom;
+    }
+    for (size_t pc = ins.put_begin; pc < ins.put_end; ++pc) {
+        CompiledRule::Put const& put = rule.put[pc];
+        switch (put.op) {
+            case CompiledRule::PUT_CONST:
+                stack.push_back(put.atom);
+                break;
+            case CompiledRule::PUT_VARIABLE:
+                stack.push_back(register_value(rule, put.arg));
+                break;
+            case CompiledRule::PUT_EXPR:
+                {
+                    std::vector<AtomPtr> children(
+                            std::make_move_iterator(stack.end() - put.arg),
+                            std::make_move_iterator(stack.end()));
+                    stack.resize(stack.size() - put.arg);
+                    stack.push_back(E(std::move(children)));
+                    break;
+                }
+        }
+    }
+    AtomPtr result = std::move(stack.back());
+    stack.pop_back();
+    return result;
+}
+
+bool RuleMachine::unify(CompiledRule const& rule, AtomPtr const& atom,
+        UnificationResult& result) {
+    if (!run(rule, atom)) {
+        return false;
+    }
+    fresh.clear();
+    result.b_bindings.clear();
+    for (auto const& binding : bindings) {
+        result.b_bindings[std::static_pointer_cast<VariableAtom>(*binding.var)] =
+            build(rule, binding.get);
+    }
+    result.unifications.clear();
+    for (auto const& unification : unifications) {
+        result.unifications.emplace_back(build(rule, unification.get),
+                apply_bindings_to_atom(*unification.atom, result.b_bindings));
+    }
+    return true;
+}
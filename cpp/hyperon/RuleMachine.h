@@ -0,0 +1,100 @@
+#ifndef RULE_MACHINE_H
+#define RULE_MACHINE_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include "GroundingSpace.h"
+
+// Rule compiled into the code of RuleMachine. Get instructions walk the rule
+// in pre-order and unify it with the atom, variables of the rule are kept in
+// registers. Put instructions build rule's sub-atoms in post-order
+// replacing variables by the values of registers, each get instruction
+// refers to the range of put instructions which builds its sub-atom.
+class CompiledRule {
+public:
+    CompiledRule(AtomPtr const& rule);
+
+private:
+    friend class RuleMachine;
+
+    enum GetOp {
+        GET_CONST,
+        // first occurrence of the variable, register is not bound yet
+        GET_VARIABLE,
+        // next occurrences of the variable
+        GET_VALUE,
+        GET_EXPR,
+    };
+    enum PutOp {
+        PUT_CONST,
+        PUT_VARIABLE,
+        PUT_EXPR,
+    };
+
+    struct Get {
+        GetOp op;
+        AtomPtr atom;
+        // register for variables, arity for expressions
+        size_t arg;
+        // instruction after the sub-atom
+        size_t end;
+        size_t put_begin;
+        size_t put_end;
+        // sub-atom has no variables and is returned as is
+        bool ground;
+    };
+    struct Put {
+        PutOp op;
+        AtomPtr atom;
+        size_t arg;
+    };
+
+    bool compile(AtomPtr const& atom);
+
+    std::vector<Get> get;
+    std::vector<Put> put;
+    std::vector<VariableAtomPtr> registers;
+};
+
+// Runs the code of compiled rules. Results are the same as results of
+// unification of the rule atom with the atom by GroundingSpace::unify(),
+// unbound variables of the rule are renamed apart. Machine keeps buffers
+// between runs, so it should be reused for the candidates of a single
+// unify() call and should not be shared between threads.
+class RuleMachine {
+public:
+    bool unify(CompiledRule const& rule, AtomPtr const& atom,
+            UnificationResult& result);
+
+private:
+    struct Binding {
+        VariableId id;
+        AtomPtr const* var;
+        size_t get;
+    };
+    struct Unification {
+        size_t get;
+        AtomPtr const* atom;
+    };
+    struct Level {
+        std::vector<AtomPtr> const* children;
+        size_t next;
+    };
+
+    bool run(CompiledRule const& rule, AtomPtr const& atom);
+    bool bind_register(size_t reg, AtomPtr const& value);
+    bool bind_variable(CompiledRule const& rule, AtomPtr const& var, size_t get);
+    AtomPtr build(CompiledRule const& rule, size_t get);
+    AtomPtr const& register_value(CompiledRule const& rule, size_t reg);
+
+    std::vector<AtomPtr const*> registers;
+    std::vector<Binding> bindings;
+    std::vector<Unification> unifications;
+    std::vector<Level> levels;
+    std::vector<AtomPtr> stack;
+    std::deque<AtomPtr> fresh;
+};
+
+#endif /* RULE_MACHINE_H */
@@ -1,47 +1,76 @@
+#include <algorithm>
 #include <regex>
 #include <stdexcept>
 
 #include "TextSpace.h"
+#include "TokenAutomaton.h"
 
 // Text space
 
 std::string TextSpace::TYPE = "TextSpace";
 
-static void skip_space(char const*& text) {
-    while (*text && std::isspace(*text)) {
+TextSpace::TextSpace() : automaton(std::make_shared<TokenAutomaton>()) { }
+
+TextSpace::~TextSpace() { }
+
+// std::regex is compiled only for the tokens which automaton doesn't support
+void TextSpace::register_token(std::string const& regex, AtomConstr constructor) {
+    std::shared_ptr<TokenAutomaton> next = std::make_shared<TokenAutomaton>(*automaton);
+    if (next->add(tokens.size(), regex)) {
+        automaton = next;
+        tokens.push_back({ std::regex(), constructor, true });
+    } else {
+        // throws std::regex_error on invalid regex
+        tokens.push_back({ std::regex(regex), constructor, false });
+    }
+}
+
+static void skip_space(char const*& text, char const* end) {
+    while (text != end && std::isspace(*text)) {
         ++text;
     }
 }
 
-static std::string next_token(char const*& text) {
+static std::string next_token(char const*& text, char const* end) {
     char const* start = text;
     // TODO: this doesn't work for string in quotes with spaces inside them,
     // to fix it we should made TokenDescr more complex and use list of token
     // descriptions to build a parser
-    while (*text && !std::isspace(*text) && *text != '(' && *text != ')') {
+    while (text != end && !std::isspace(*text) && *text != '(' && *text != ')') {
         ++text;
     }
     return std::string(start, text);
 }
 
-static std::string show_position(char const* text, char const* pos) {
-    return std::string(text, pos) + ">" + std::string(1, *pos) + "<" +
-            (*pos ? std::string(pos + 1) : "");
+static std::string show_position(std::string_view text, char const* pos) {
+    char const* end = text.data() + text.size();
+    return std::string(text.data(), pos) + ">" + std::string(1, pos != end ? *pos : '\0') +
+            "<" + (pos != end ? std::string(pos + 1, end) : "");
 }
 
-static void parse_error(char const* text, char const* pos, std::string message) {
+static void parse_error(std::string_view text, char const* pos, std::string message) {
     throw std::runtime_error(message + "\n" + show_position(text, pos));
 }
 
-AtomPtr TextSpace::find_token(char const*& text) const {
-    for (auto const& pair : tokens) {
+AtomPtr TextSpace::find_token(char const*& text, char const* end) const {
+    TokenAutomaton::Match found = automaton->match(text, end);
+    // tokens which are not compiled are checked up to the automaton's winner
+    size_t winner = std::min(found.priority, tokens.size());
+    for (size_t i = 0; i < winner; ++i) {
+        Token const& token = tokens[i];
         std::cmatch match;
-        if (std::regex_search(text, match, pair.first, std::regex_constants::match_continuous)) {
+        if (!token.compiled && std::regex_search(text, end, match, token.regex,
+                    std::regex_constants::match_continuous)) {
             text += match.length();
-            return pair.second(match.str());
+            return token.constructor(match.str());
         }
     }
-    return Atom::INVALID;
+    if (found.priority == TokenAutomaton::NO_MATCH) {
+        return Atom::INVALID;
+    }
+    std::string value(text, found.length);
+    text += found.length;
+    return tokens[found.priority].constructor(value);
 }
 
 struct TextSpace::ParseResult {
@@ -49,19 +78,23 @@ struct TextSpace::ParseResult {
     bool is_eof;
 };
 
-TextSpace::ParseResult  TextSpace::recursive_parse(char const* text, char const*& pos) const {
-    skip_space(pos);
+TextSpace::ParseResult  TextSpace::recursive_parse(std::string_view text, char const*& pos) const {
+    char const* end = text.data() + text.size();
+    skip_space(pos, end);
+    if (pos == end) {
+        return { Atom::INVALID, true };
+    }
     switch (*pos) {
         case '$':
             ++pos;
-            return { V(next_token(pos)), false };
+            return { V(next_token(pos, end)), false };
         case '(':
             {
                 ++pos;
                 std::vector<AtomPtr> children;
                 while (true) {
-                    skip_space(pos);
-                    if (*pos == ')') {
+                    skip_space(pos, end);
+                    if (pos != end && *pos == ')') {
                         ++pos;
                         break;
                     }
@@ -74,26 +107,23 @@ TextSpace::ParseResult  TextSpace::recursive_parse(char const* text, char const*
                 AtomPtr atom = E(children);
                 return { atom, false };
             }
-        case '\0':
-            return { Atom::INVALID, true };
         default:
             {
-                AtomPtr atom = find_token(pos);
+                AtomPtr atom = find_token(pos, end);
                 if (atom) {
                     return { atom, false };
                 } else {
-                    std::string token = next_token(pos);
+                    std::string token = next_token(pos, end);
                     return { S(token), false };
                 }
             }
     };
 }
 
-void TextSpace::parse(std::string text, std::function<void(AtomPtr)> add) const {
-    char const* c_str = text.c_str();
-    char const* pos = c_str;
+void TextSpace::parse(std::string_view text, std::function<void(AtomPtr)> add) const {
+    char const* pos = text.data();
     while (true) {
-        ParseResult result = recursive_parse(c_str, pos);
+        ParseResult result = recursive_parse(text, pos);
         if (result.is_eof) {
             break;
         }
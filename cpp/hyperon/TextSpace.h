@@ -3,11 +3,15 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
 #include <regex>
+#include <string_view>
 
 #include "SpaceAPI.h"
 #include "GroundingSpace.h"
 
+class TokenAutomaton;
+
 // Text space
 
 class TextSpace : public SpaceAPI {
@@ -18,7 +22,8 @@ public:
     using AtomConstr = std::function<AtomPtr(std::string)>;
     using TokenDescr = std::pair<std::regex, AtomConstr>;
 
-    virtual ~TextSpace() { }
+    TextSpace();
+    virtual ~TextSpace();
 
     void add_to(SpaceAPI& space) const override;
 
@@ -37,20 +42,41 @@ public:
     // separate set of tokens in each TextSpace and allow using different
     // parsers in parallel. Last solution looks more flexible. We could also
     // pass list of tokens into TextSpace constructor.
+    // Tokens are tried in the order of registration, the first token which
+    // matches the text wins. Tokens registered by the regex string are
+    // compiled into a single automaton which matches all of them in one pass
+    // through the text.
+    void register_token(std::string const& regex, AtomConstr constructor);
+    // std::regex cannot be compiled into the automaton, such tokens are
+    // matched one by one
     void register_token(std::regex regex, AtomConstr constructor) {
-        tokens.push_back(TokenDescr(regex, constructor));
+        tokens.push_back({ regex, constructor, false });
     }
 
+    // Parses text and passes each atom to add. Text is not copied, it
+    // should outlive the call only. Parsing doesn't change the space, so
+    // one space can parse from many threads at once when the token
+    // constructors can.
+    void parse(std::string_view text, std::function<void(AtomPtr)> add) const;
+
 private:
 
     struct ParseResult;
+    struct Token {
+        // empty when token is matched by automaton
+        std::regex regex;
+        AtomConstr constructor;
+        // true when token is matched by automaton
+        bool compiled;
+    };
 
-    AtomPtr find_token(const char*& text) const;
-    ParseResult  recursive_parse(char const* text, char const*& pos) const;
-    void parse(std::string text, std::function<void(AtomPtr)> add) const;
+    AtomPtr find_token(const char*& text, char const* end) const;
+    ParseResult  recursive_parse(std::string_view text, char const*& pos) const;
 
     std::vector<std::string> code; 
-    std::vector<TokenDescr> tokens;
+    std::vector<Token> tokens;
+    // Shared by copies of the space, replaced on registration
+    std::shared_ptr<TokenAutomaton const> automaton;
 };
 
 #endif /* TEXT_SPACE_H */
@@ -0,0 +1,530 @@
+#include "TokenAutomaton.h"
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <limits>
+
+static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+// States beyond this number are not cached, transitions from them are
+// computed on each match
+static constexpr size_t MAX_STATES = 4096;
+static constexpr int MAX_REPEAT = 1000;
+static constexpr int INFINITE = -1;
+
+struct TokenAutomaton::State {
+    // CHARS nodes
+    std::vector<uint32_t> nodes;
+    // Priorities of the regexes matched, sorted
+    std::vector<uint32_t> accepting;
+    // Lowest priority of CHARS nodes, NONE when no node can consume input
+    uint32_t min_live = NONE;
+    mutable std::atomic<State const*> next[256] = {};
+};
+
+// Regex parser
+
+namespace {
+
+// Thrown when regex uses syntax which automaton doesn't support
+struct Unsupported { };
+
+struct RegexNode {
+    enum Type {
+        CHARS,
+        CONCAT,
+        ALTERNATION,
+        REPEAT
+    };
+    Type type = CHARS;
+    std::bitset<256> chars{};
+    std::vector<RegexNode> children{};
+    int min = 1;
+    int max = 1;
+};
+
+// Character classes of std::regex in the "C" locale
+static std::bitset<256> char_class(char name) {
+    std::bitset<256> chars;
+    for (int c = 0; c < 256; ++c) {
+        switch (std::tolower(name)) {
+            case 'd': chars[c] = c >= '0' && c <= '9'; break;
+            case 'w': chars[c] = std::isalnum(c) || c == '_'; break;
+            case 's': chars[c] = c == ' ' || (c >= '\t' && c <= '\r'); break;
+        }
+    }
+    return std::isupper(name) ? ~chars : chars;
+}
+
+static std::bitset<256> single(unsigned char c) {
+    std::bitset<256> chars;
+    chars[c] = true;
+    return chars;
+}
+
+// Returns true when node matches the empty string
+static bool nullable(RegexNode const& node) {
+    switch (node.type) {
+        case RegexNode::CHARS:
+            return false;
+        case RegexNode::CONCAT:
+            return std::all_of(node.children.begin(), node.children.end(), nullable);
+        case RegexNode::ALTERNATION:
+            return std::any_of(node.children.begin(), node.children.end(), nullable);
+        case RegexNode::REPEAT:
+            return node.min == 0 || nullable(node.children[0]);
+    }
+    return false;
+}
+
+class RegexParser {
+public:
+    RegexParser(std::string const& text) : text(text) { }
+
+    RegexNode parse() {
+        RegexNode node = alternation();
+        if (pos != text.size()) {
+            throw Unsupported();
+        }
+        return node;
+    }
+
+private:
+
+    bool at_end() const { return pos == text.size(); }
+    char peek() const { return text[pos]; }
+
+    RegexNode alternation() {
+        RegexNode node{ RegexNode::ALTERNATION };
+        node.children.push_back(concatenation());
+        while (!at_end() && peek() == '|') {
+            ++pos;
+            node.children.push_back(concatenation());
+        }
+        return node;
+    }
+
+    RegexNode concatenation() {
+        RegexNode node{ RegexNode::CONCAT };
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            node.children.push_back(repeat());
+        }
+        return node;
+    }
+
+    RegexNode repeat() {
+        RegexNode atom = this->atom();
+        while (!at_end()) {
+            int min, max;
+            switch (peek()) {
+                case '*': min = 0; max = INFINITE; ++pos; break;
+                case '+': min = 1; max = INFINITE; ++pos; break;
+                case '?': min = 0; max = 1; ++pos; break;
+                case '{': bounds(min, max); break;
+                default: return atom;
+            }
+            if (!at_end() && peek() == '?') {
+                // lazy quantifier
+                throw Unsupported();
+            }
+            if (nullable(atom)) {
+                // std::regex stops repeating on the empty match
+                throw Unsupported();
+            }
+            RegexNode node{ RegexNode::REPEAT };
+            node.children.push_back(std::move(atom));
+            node.min = min;
+            node.max = max;
+            atom = std::move(node);
+        }
+        return atom;
+    }
+
+    int number() {
+        size_t start = pos;
+        int value = 0;
+        while (!at_end() && std::isdigit(peek())) {
+            value = value * 10 + (text[pos++] - '0');
+            if (value > MAX_REPEAT) {
+                throw Unsupported();
+            }
+        }
+        if (pos == start) {
+            throw Unsupported();
+        }
+        return value;
+    }
+
+    void bounds(int& min, int& max) {
+        ++pos;
+        min = number();
+        max = min;
+        if (!at_end() && peek() == ',') {
+            ++pos;
+            max = !at_end() && peek() == '}' ? INFINITE : number();
+        }
+        if (at_end() || peek() != '}' || (max != INFINITE && max < min)) {
+            throw Unsupported();
+        }
+        ++pos;
+    }
+
+    RegexNode chars(std::bitset<256> const& chars) {
+        RegexNode node{ RegexNode::CHARS };
+        node.chars = chars;
+        return node;
+    }
+
+    RegexNode atom() {
+        char c = text[pos++];
+        switch (c) {
+            case '(':
+                {
+                    if (!at_end() && peek() == '?') {
+                        if (text.compare(pos, 2, "?:") != 0) {
+                            // lookahead
+                            throw Unsupported();
+                        }
+                        pos += 2;
+                    }
+                    RegexNode node = alternation();
+                    if (at_end() || peek() != ')') {
+                        throw Unsupported();
+                    }
+                    ++pos;
+                    return node;
+                }
+            case '[':
+                return chars(char_set());
+            case '.':
+                return chars(~(single('\n') | single('\r')));
+            case '\\':
+                return chars(escape(false));
+            case '^':
+            case '$':
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                throw Unsupported();
+            default:
+                return chars(single(c));
+        }
+    }
+
+    std::bitset<256> escape(bool in_class) {
+        if (at_end()) {
+            throw Unsupported();
+        }
+        char c = text[pos++];
+        switch (c) {
+            case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+                return char_class(c);
+            case 't': return single('\t');
+            case 'n': return single('\n');
+            case 'v': return single('\v');
+            case 'f': return single('\f');
+            case 'r': return single('\r');
+            case 'x':
+                {
+                    if (pos + 2 > text.size() || !std::isxdigit(text[pos])
+                            || !std::isxdigit(text[pos + 1])) {
+                        throw Unsupported();
+                    }
+                    unsigned char value = std::stoi(text.substr(pos, 2), nullptr, 16);
+                    pos += 2;
+                    return single(value);
+                }
+            case 'b':
+                if (in_class) {
+                    return single('\b');
+                }
+                // word boundary
+                throw Unsupported();
+            default:
+                // backreferences, \B, \c, \u and \0
+                if (std::isalnum(c)) {
+                    throw Unsupported();
+                }
+                return single(c);
+        }
+    }
+
+    // Returns the character or NONE for escaped classes
+    uint32_t class_atom(std::bitset<256>& chars) {
+        if (at_end()) {
+            throw Unsupported();
+        }
+        char c = text[pos++];
+        if (c != '\\') {
+            chars = single(c);
+            return static_cast<unsigned char>(c);
+        }
+        chars = escape(true);
+        if (chars.count() != 1) {
+            return NONE;
+        }
+        uint32_t value = 0;
+        while (!chars[value]) {
+            ++value;
+        }
+        return value;
+    }
+
+    std::bitset<256> char_set() {
+        bool negate = !at_end() && peek() == '^';
+        if (negate) {
+            ++pos;
+        }
+        if (!at_end() && peek() == ']') {
+            // empty class
+            throw Unsupported();
+        }
+        std::bitset<256> result;
+        while (true) {
+            if (at_end()) {
+                throw Unsupported();
+            }
+            if (peek() == ']') {
+                ++pos;
+                break;
+            }
+            std::bitset<256> chars;
+            uint32_t from = class_atom(chars);
+            if (pos + 1 < text.size() && peek() == '-' && text[pos + 1] != ']') {
+                ++pos;
+                std::bitset<256> to_chars;
+                uint32_t to = class_atom(to_chars);
+                if (from == NONE || to == NONE || to < from) {
+                    throw Unsupported();
+                }
+                for (uint32_t c = from; c <= to; ++c) {
+                    chars[c] = true;
+                }
+            }
+            result |= chars;
+        }
+        return negate ? ~result : result;
+    }
+
+    std::string const& text;
+    size_t pos = 0;
+};
+
+} // namespace
+
+// Automaton
+
+TokenAutomaton::TokenAutomaton() { }
+
+TokenAutomaton::TokenAutomaton(TokenAutomaton const& other)
+    : nodes(other.nodes), starts(other.starts) { }
+
+TokenAutomaton::~TokenAutomaton() { }
+
+bool TokenAutomaton::add(size_t priority, std::string const& regex) {
+    RegexNode root;
+    try {
+        root = RegexParser(regex).parse();
+    } catch (Unsupported const&) {
+        return false;
+    }
+    auto add_node = [this, priority](Node::Type type, uint32_t out, uint32_t alt) -> uint32_t {
+        nodes.push_back({ type, static_cast<uint32_t>(priority), out, alt, {} });
+        return nodes.size() - 1;
+    };
+    // NFA is built backwards: node is compiled knowing the node which
+    // follows it
+    std::function<uint32_t(RegexNode const&, uint32_t)> compile =
+        [&](RegexNode const& node, uint32_t next) -> uint32_t {
+            switch (node.type) {
+                case RegexNode::CHARS:
+                    {
+                        uint32_t index = add_node(Node::CHARS, next, NONE);
+                        nodes[index].chars = node.chars;
+                        return index;
+                    }
+                case RegexNode::CONCAT:
+                    for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+                        next = compile(*it, next);
+                    }
+                    return next;
+                case RegexNode::ALTERNATION:
+                    {
+                        uint32_t start = compile(node.children.back(), next);
+                        for (size_t i = node.children.size() - 1; i > 0; --i) {
+                            start = add_node(Node::SPLIT, compile(node.children[i - 1], next), start);
+                        }
+                        return start;
+                    }
+                case RegexNode::REPEAT:
+                    {
+                        RegexNode const& child = node.children[0];
+                        uint32_t start = next;
+                        if (node.max == INFINITE) {
+                            uint32_t loop = add_node(Node::SPLIT, NONE, next);
+                            nodes[loop].out = compile(child, loop);
+                            start = loop;
+                        } else {
+                            for (int i = node.min; i < node.max; ++i) {
+                                start = add_node(Node::SPLIT, compile(child, start), next);
+                            }
+                        }
+                        for (int i = 0; i < node.min; ++i) {
+                            start = compile(child, start);
+                        }
+                        return start;
+                    }
+            }
+            return next;
+        };
+    size_t first = nodes.size();
+    uint32_t match = add_node(Node::MATCH, NONE, NONE);
+    uint32_t start = compile(root, match);
+    if (!is_deterministic(first)) {
+        nodes.resize(first);
+        return false;
+    }
+    starts.push_back(start);
+    return true;
+}
+
+// std::regex takes the first match found by backtracking: it prefers the
+// left alternative and one more repetition. The automaton returns the
+// longest match instead. They agree when each SPLIT can be passed by one
+// branch only: branches start with different characters and the preferred
+// branch doesn't reach the end of regex while the other one can go on.
+bool TokenAutomaton::is_deterministic(size_t first) const {
+    for (size_t index = first; index < nodes.size(); ++index) {
+        Node const& node = nodes[index];
+        if (node.type != Node::SPLIT) {
+            continue;
+        }
+        std::bitset<256> out_chars;
+        bool out_matches = false;
+        for (uint32_t next : closure({ node.out })) {
+            if (nodes[next].type == Node::MATCH) {
+                out_matches = true;
+            } else {
+                out_chars |= nodes[next].chars;
+            }
+        }
+        std::bitset<256> alt_chars;
+        for (uint32_t next : closure({ node.alt })) {
+            if (nodes[next].type == Node::CHARS) {
+                alt_chars |= nodes[next].chars;
+            }
+        }
+        if ((out_chars & alt_chars).any() || (out_matches && alt_chars.any())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns sorted CHARS and MATCH nodes reachable from the given nodes
+std::vector<uint32_t> TokenAutomaton::closure(std::vector<uint32_t> const& from) const {
+    std::vector<bool> visited(nodes.size());
+    std::vector<uint32_t> stack(from);
+    std::vector<uint32_t> result;
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        if (index == NONE || visited[index]) {
+            continue;
+        }
+        visited[index] = true;
+        Node const& node = nodes[index];
+        if (node.type == Node::SPLIT) {
+            stack.push_back(node.alt);
+            stack.push_back(node.out);
+        } else {
+            result.push_back(index);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::unique_ptr<TokenAutomaton::State> TokenAutomaton::make_state(
+        std::vector<uint32_t> const& key) const {
+    std::unique_ptr<State> state(new State());
+    for (uint32_t index : key) {
+        Node const& node = nodes[index];
+        if (node.type == Node::MATCH) {
+            state->accepting.push_back(node.priority);
+        } else {
+            state->nodes.push_back(index);
+            state->min_live = std::min(state->min_live, node.priority);
+        }
+    }
+    std::sort(state->accepting.begin(), state->accepting.end());
+    return state;
+}
+
+TokenAutomaton::State const* TokenAutomaton::start_state() const {
+    State const* state = start.load(std::memory_order_acquire);
+    if (state) {
+        return state;
+    }
+    std::vector<uint32_t> key = closure(starts);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<State>& cached = states[key];
+    if (!cached) {
+        cached = make_state(key);
+    }
+    start.store(cached.get(), std::memory_order_release);
+    return cached.get();
+}
+
+TokenAutomaton::State const* TokenAutomaton::next_state(State const& state,
+        unsigned char c, std::unique_ptr<State>& uncached) const {
+    std::vector<uint32_t> next;
+    for (uint32_t index : state.nodes) {
+        if (nodes[index].chars[c]) {
+            next.push_back(nodes[index].out);
+        }
+    }
+    std::vector<uint32_t> key = closure(next);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = states.find(key);
+    if (it == states.end()) {
+        if (states.size() >= MAX_STATES) {
+            uncached = make_state(key);
+            return uncached.get();
+        }
+        it = states.emplace(key, make_state(key)).first;
+    }
+    // transitions of uncached state are not kept
+    if (&state != uncached.get()) {
+        state.next[c].store(it->second.get(), std::memory_order_release);
+    }
+    return it->second.get();
+}
+
+TokenAutomaton::Match TokenAutomaton::match(char const* text, char const* end) const {
+    Match best{ NO_MATCH, 0 };
+    State const* state = start_state();
+    std::unique_ptr<State> uncached;
+    for (size_t length = 0; ; ++length) {
+        if (!state->accepting.empty()) {
+            if (state->accepting[0] < best.priority) {
+                best = { state->accepting[0], length };
+            } else if (std::binary_search(state->accepting.begin(),
+                        state->accepting.end(), best.priority)) {
+                best.length = length;
+            }
+        }
+        // regexes left have lower priority than the one matched
+        if (state->min_live == NONE || (best.priority != NO_MATCH && state->min_live > best.priority)) {
+            break;
+        }
+        if (text + length == end) {
+            break;
+        }
+        unsigned char c = text[length];
+        State const* next = state->next[c].load(std::memory_order_acquire);
+        state = next ? next : next_state(*state, c, uncached);
+    }
+    return best;
+}
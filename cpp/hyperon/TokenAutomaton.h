@@ -0,0 +1,82 @@
+#ifndef TOKEN_AUTOMATON_H
+#define TOKEN_AUTOMATON_H
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Matches the beginning of the text with all token regexes at once. Regexes
+// are compiled into a single NFA, states of the equivalent DFA are built
+// lazily when text reaches them and are cached, so each byte of the token
+// is examined once. Of the regexes which match, the one with the lowest
+// priority number wins and its longest match is returned.
+//
+// Regexes use ECMAScript syntax of std::regex: literals and escapes,
+// character classes, ".", groups, alternation and greedy quantifiers.
+// Regexes with other features (anchors, backreferences, lookahead, lazy
+// quantifiers) are not added and should be matched by std::regex. The
+// longest match is the match std::regex returns only when the next
+// character always selects the branch of alternation or quantifier, so
+// regexes like "a|ab", "a*(ab)?" or "(|a)" are not added either.
+//
+// match() can be called from many threads at once.
+class TokenAutomaton {
+public:
+    static constexpr size_t NO_MATCH = static_cast<size_t>(-1);
+
+    struct Match {
+        size_t priority;
+        size_t length;
+    };
+
+    TokenAutomaton();
+    // Copies regexes, states are built again
+    TokenAutomaton(TokenAutomaton const& other);
+    ~TokenAutomaton();
+
+    // Returns false when regex uses syntax which is not supported
+    bool add(size_t priority, std::string const& regex);
+    // Matches text up to end, returns priority NO_MATCH when no regex
+    // matches
+    Match match(char const* text, char const* end) const;
+
+private:
+    struct Node {
+        enum Type {
+            CHARS,
+            SPLIT,
+            MATCH
+        };
+        Type type;
+        uint32_t priority;
+        // next node, for SPLIT both out and alt are followed
+        uint32_t out;
+        uint32_t alt;
+        std::bitset<256> chars;
+    };
+    struct State;
+
+    State const* start_state() const;
+    State const* next_state(State const& state, unsigned char c,
+            std::unique_ptr<State>& uncached) const;
+    std::vector<uint32_t> closure(std::vector<uint32_t> const& nodes) const;
+    std::unique_ptr<State> make_state(std::vector<uint32_t> const& key) const;
+    bool is_deterministic(size_t first) const;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> starts;
+
+    // Cache of the DFA states keyed by sorted indexes of CHARS and MATCH
+    // nodes. Transitions are published atomically, the lock is taken only
+    // to add a transition.
+    mutable std::mutex mutex;
+    mutable std::map<std::vector<uint32_t>, std::unique_ptr<State>> states;
+    mutable std::atomic<State const*> start{nullptr};
+};
+
+#endif /* TOKEN_AUTOMATON_H */
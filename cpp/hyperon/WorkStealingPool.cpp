@@ -0,0 +1,138 @@
+#include "WorkStealingPool.h"
+
+#include <thread>
+#include <algorithm>
+
+// Pool and index of the worker which runs on the current thread
+static thread_local WorkStealingPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+// Number of attempts to find a task before idle worker goes to sleep
+static size_t const IDLE_SPINS = 64;
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+    : pending(0), queued(0), sleeping(0), next_queue(0), failed(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues.emplace_back(new Queue());
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    size_t worker = current_pool == this ? current_worker
+        : next_queue++ % queues.size();
+    ++pending;
+    {
+        Queue& queue = *queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        ++queued;
+    }
+    // worker which goes to sleep increments sleeping before it checks
+    // queued, so either it sees the task or the task's submitter sees it
+    if (sleeping > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        idle.notify_one();
+    }
+}
+
+bool WorkStealingPool::pop(size_t worker, Task& task) {
+    Queue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --queued;
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t worker, Task& task) {
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::wait_for_task() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    ++sleeping;
+    idle.wait(lock, [this]() -> bool { return queued > 0 || pending == 0 || failed; });
+    --sleeping;
+}
+
+void WorkStealingPool::wake_all() {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    idle.notify_all();
+}
+
+void WorkStealingPool::work(size_t worker) {
+    WorkStealingPool* prev_pool = current_pool;
+    size_t prev_worker = current_worker;
+    current_pool = this;
+    current_worker = worker;
+    Task task;
+    size_t spins = 0;
+    while (pending > 0 && !failed) {
+        if (!pop(worker, task) && !steal(worker, task)) {
+            if (++spins < IDLE_SPINS) {
+                std::this_thread::yield();
+            } else {
+                wait_for_task();
+                spins = 0;
+            }
+            continue;
+        }
+        spins = 0;
+        try {
+            task();
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            failed = true;
+            wake_all();
+        }
+        task = nullptr;
+        if (--pending == 0) {
+            wake_all();
+        }
+    }
+    current_pool = prev_pool;
+    current_worker = prev_worker;
+}
+
+void WorkStealingPool::run() {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < queues.size(); ++i) {
+        threads.emplace_back(&WorkStealingPool::work, this, i);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failed) {
+        for (auto& queue : queues) {
+            queue->tasks.clear();
+        }
+        pending = 0;
+        queued = 0;
+        failed = false;
+        std::exception_ptr rethrown = error;
+        error = nullptr;
+        std::rethrow_exception(rethrown);
+    }
+}
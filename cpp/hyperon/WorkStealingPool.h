@@ -0,0 +1,60 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+// Pool of threads executing tasks which can submit other tasks. Each worker
+// has its own deque: worker pushes and pops tasks at the back, idle worker
+// steals tasks from the front of the other deques. Worker which finds no
+// task spins for a while and then sleeps until a task is submitted. Threads
+// are started by run() and stopped when all tasks are finished.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    WorkStealingPool(size_t threads);
+
+    // Adds task to the deque of the calling worker, or distributes tasks
+    // between workers when called outside of the pool
+    void submit(Task task);
+    // Runs tasks until all of them including submitted by other tasks are
+    // finished. Rethrows the first exception thrown by a task, tasks left
+    // are dropped in such case.
+    void run();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(size_t worker);
+    bool pop(size_t worker, Task& task);
+    bool steal(size_t worker, Task& task);
+    void wait_for_task();
+    void wake_all();
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    // Tasks submitted and not finished
+    std::atomic<size_t> pending;
+    // Tasks in the queues
+    std::atomic<size_t> queued;
+    // Idle workers wait for a task, submit() notifies them only when some
+    // of them are sleeping
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::atomic<size_t> sleeping;
+    std::atomic<size_t> next_queue;
+    std::atomic<bool> failed;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+#endif /* WORK_STEALING_POOL_H */
@@ -3,22 +3,23 @@
 #include "GroundedArithmetic.h"
 #include "GroundedLogic.h"
 
-void Atomese::parse(std::string program, GroundingSpace& kb) const {
-    TextSpace parser;
+Atomese::Atomese() {
     init_parser(parser);
-    parser.add_string(program);
-    kb.add_from_space(parser);
+}
+
+void Atomese::parse(std::string_view program, GroundingSpace& kb) const {
+    parser.parse(program, [&kb](AtomPtr atom) -> void { kb.add_atom(atom); });
 }
 
 static void register_token_string_regex(TextSpace& parser, std::string regex, TextSpace::AtomConstr constr) {
-    parser.register_token(std::regex(regex), constr);
+    parser.register_token(regex, constr);
 }
 
 static void register_token_without_params(TextSpace& parser, std::string regex, AtomPtr atom) {
     register_token_string_regex(parser, regex, [atom](std::string) -> AtomPtr { return atom; });
 }
 
-void Atomese::init_parser(TextSpace& parser) const {
+void Atomese::init_parser(TextSpace& parser) {
     register_token_without_params(parser, "\\+", ADD);
     register_token_without_params(parser, "\\-", SUB);
     register_token_without_params(parser, "\\*", MUL);
@@ -1,17 +1,24 @@
 #ifndef ATOMESE_H
 #define ATOMESE_H
 
-#include <string>
+#include <string_view>
 
 #include <hyperon/GroundingSpace.h>
 #include <hyperon/TextSpace.h>
 
+// Parser of the Atomese programs. Tokens are compiled once when parser is
+// constructed, so one parser should be kept and reused. Parser is not
+// changed by parsing and can be shared by many threads.
 class Atomese {
 public:
-    void parse(std::string program, GroundingSpace& kb) const;
+    Atomese();
+
+    void parse(std::string_view program, GroundingSpace& kb) const;
 
 private:
-    void init_parser(TextSpace& parser) const;
+    static void init_parser(TextSpace& parser);
+
+    TextSpace parser;
 };
 
 #endif /* ATOMESE_H */
@@ -6,9 +6,9 @@ public:
     BinaryOpAtom(std::string symbol) : symbol(symbol) { }
     virtual ~BinaryOpAtom() { }
 
-    void execute(GroundingSpace const& args, GroundingSpace& result) const override {
-        AtomPtr const& _a = args.get_content()[1];
-        AtomPtr const& _b = args.get_content()[2];
+    void execute(AtomSpan args, AtomSink& result) const override {
+        AtomPtr const& _a = args[1];
+        AtomPtr const& _b = args[2];
         T const* a = dynamic_cast<T const*>(_a.get());
         T const* b = dynamic_cast<T const*>(_b.get());
         if (!a || !b) {
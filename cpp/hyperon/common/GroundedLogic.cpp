@@ -7,9 +7,9 @@ class EqAtom : public GroundedAtom {
 public:
     virtual ~EqAtom() { }
 
-    void execute(GroundingSpace const& args, GroundingSpace& result) const override {
-        AtomPtr const& a = args.get_content()[1];
-        AtomPtr const& b = args.get_content()[2];
+    void execute(AtomSpan args, AtomSink& result) const override {
+        AtomPtr const& a = args[1];
+        AtomPtr const& b = args[2];
         result.add_atom(Bool(*a == *b));
     }
     bool operator==(Atom const& _other) const override { 
@@ -23,10 +23,10 @@ const GroundedAtomPtr EQ = std::shared_ptr<EqAtom>(new EqAtom());
 class IfAtom : public GroundedAtom {
 public:
     virtual ~IfAtom() {}
-    void execute(GroundingSpace const& args, GroundingSpace& result) const override {
-        AtomPtr _condition = args.get_content()[1];
-        AtomPtr if_true = args.get_content()[2];
-        AtomPtr if_false = args.get_content().size() > 3 ? args.get_content()[3] : nullptr;
+    void execute(AtomSpan args, AtomSink& result) const override {
+        AtomPtr const& _condition = args[1];
+        AtomPtr const& if_true = args[2];
+        AtomPtr if_false = args.size() > 3 ? args[3] : nullptr;
         BoolAtom const* condition = dynamic_cast<BoolAtom*>(_condition.get());
         if (!condition) {
             throw new std::runtime_error("Cannot cast condition to bool, condition: " +
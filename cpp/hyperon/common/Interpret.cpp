@@ -1,9 +1,19 @@
 #include "common.h"
 
 AtomPtr interpret_until_result(GroundingSpace& target, GroundingSpace const& kb) {
+    Stats::Timer timer(Stats::INTERPRET_LATENCY);
     AtomPtr result;
     do {
         result = target.interpret_step(kb);
     } while (result == Atom::INVALID);
     return result;
 }
+
+AtomPtr interpret_until_result(Interpreter& interpreter) {
+    Stats::Timer timer(Stats::INTERPRET_LATENCY);
+    AtomPtr result;
+    do {
+        result = interpreter.step();
+    } while (result == Atom::INVALID);
+    return result;
+}
@@ -2,7 +2,9 @@
 #define INTERPRET_H
 
 #include <hyperon/GroundingSpace.h>
+#include <hyperon/Interpreter.h>
 
 AtomPtr interpret_until_result(GroundingSpace& target, GroundingSpace const& kb);
+AtomPtr interpret_until_result(Interpreter& interpreter);
 
 #endif /* INTERPRET_H */
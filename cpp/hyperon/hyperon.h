@@ -2,8 +2,12 @@
 #define HYPERON_H
 
 #include "logger.h"
+#include "tracer.h"
+#include "stats.h"
+#include "profiler.h"
 #include "SpaceAPI.h"
 #include "GroundingSpace.h"
+#include "Interpreter.h"
 #include "TextSpace.h"
 
 #endif /* HYPERON_H */
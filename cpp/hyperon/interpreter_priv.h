@@ -0,0 +1,37 @@
+#ifndef INTERPRETER_PRIV_H
+#define INTERPRETER_PRIV_H
+
+#include <vector>
+
+#include "GroundingSpace.h"
+
+// Steps of the interpretation shared by GroundingSpace::interpret_step() and
+// Interpreter
+
+struct ExecutionResult {
+    bool success;
+    std::vector<AtomPtr> results;
+};
+
+// Variable which is used by interpreter to get the value of the function
+// call from the (= (f args...) $X) unification
+extern VariableAtomPtr const RESULT;
+// Returned by interpreter when there is nothing left to interpret
+extern AtomPtr const EOS;
+
+bool is_grounded_expression(ExprAtomPtr const& expr);
+bool is_plain_expression(ExprAtomPtr const& expr);
+ExecutionResult execute_grounded_expression(ExprAtomPtr const& expr);
+
+// Unifies (= expr $X) with the knowledge base
+std::vector<UnificationResult> unify_function_call(GroundingSpace const& kb,
+        ExprAtomPtr const& expr);
+// Returns value of $X wrapped by ifmatch expressions which check the
+// unifications left after unify_function_call()
+AtomPtr function_call_result(UnificationResult const& result);
+
+AtomPtr apply_bindings_to_atom(AtomPtr const& atom, Bindings const& bindings);
+// Appends variables of the atom which are not in vars in order of occurrence
+void collect_variables(AtomPtr const& atom, std::vector<VariableAtomPtr>& vars);
+
+#endif /* INTERPRETER_PRIV_H */
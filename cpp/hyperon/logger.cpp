@@ -1,9 +1,22 @@
 #include "logger_priv.h"
 
-Logger::Level Logger::level = Logger::ERROR;
+std::atomic<Logger::Level> Logger::level{Logger::ERROR};
 
-LoggerImpl clog::error(Logger::ERROR);
-LoggerImpl clog::info(Logger::INFO);
-LoggerImpl clog::debug(Logger::DEBUG);
-LoggerImpl clog::trace(Logger::TRACE);
+std::mutex LoggerImpl::mutex;
+
+std::ostringstream& LoggerImpl::buffer() {
+    static thread_local std::ostringstream buffer;
+    return buffer;
+}
+
+void LoggerImpl::flush() {
+    std::ostringstream& line = buffer();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::clog << line.str();
+    }
+    line.str("");
+}
+
+LoggerImpl clog::logger;
 
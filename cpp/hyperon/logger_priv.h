@@ -3,46 +3,66 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <mutex>
 
 #include "logger.h"
 
+// Most verbose level of the messages which are compiled in, messages of
+// the levels above it are removed at compile time. By default TRACE and
+// DEBUG messages are removed from release builds.
+#ifndef HYPERON_LOG_LEVEL
+#ifdef NDEBUG
+#define HYPERON_LOG_LEVEL Logger::INFO
+#else
+#define HYPERON_LOG_LEVEL Logger::TRACE
+#endif
+#endif
+
+// Each thread collects the line in its own buffer, the line is written
+// into std::clog under the lock when std::endl is received, so lines
+// written by different threads are not mixed. Level is checked by LOG_*
+// macros before the message is formatted.
 class LoggerImpl {
 public:
 
     template<typename T>
     LoggerImpl& operator<<(const T& data) {
-        if (level <= Logger::getLevel()) {
-            std::clog << data;
-        }
+        buffer() << data;
         return *this;
     }
 
     LoggerImpl& operator<<(std::ostream& (&endl)(std::ostream& os)) {
-        if (level <= Logger::getLevel()) {
-            std::clog << endl;
-        }
+        buffer() << endl;
+        flush();
         return *this;
     }
 
-    LoggerImpl(Logger::Level level) : level(level) { }
+    static bool is_enabled(Logger::Level level) {
+        return level <= HYPERON_LOG_LEVEL && level <= Logger::getLevel();
+    }
 
 private:
 
-    Logger::Level level;
+    static std::ostringstream& buffer();
+    static void flush();
+
+    static std::mutex mutex;
 };
 
 namespace clog {
 
-extern LoggerImpl error;
-extern LoggerImpl info;
-extern LoggerImpl debug;
-extern LoggerImpl trace;
+extern LoggerImpl logger;
 
 };
 
-#define LOG_ERROR (clog::error << "ERROR: " << __func__ << ": ")
-#define LOG_INFO (clog::info << "INFO:  " << __func__ << ": ")
-#define LOG_DEBUG (clog::debug << "DEBUG: " << __func__ << ": ")
-#define LOG_TRACE (clog::trace << "TRACE: " << __func__ << ": ")
+// Arguments of the message are not evaluated when level is disabled
+#define LOG_AT(level, prefix) \
+    if (!LoggerImpl::is_enabled(level)) { } else clog::logger << prefix << __func__ << ": "
+
+#define LOG_ERROR LOG_AT(Logger::ERROR, "ERROR: ")
+#define LOG_INFO LOG_AT(Logger::INFO, "INFO:  ")
+#define LOG_DEBUG LOG_AT(Logger::DEBUG, "DEBUG: ")
+#define LOG_TRACE LOG_AT(Logger::TRACE, "TRACE: ")
 
 #endif /* LOGGER_PRIV_H */
@@ -0,0 +1,144 @@
+#include "profiler_priv.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<bool> Profiler::enabled{false};
+
+struct ProfileEntry {
+    // Keeps atom alive, so its address is not reused by other atom
+    AtomPtr atom;
+    size_t position;
+    uint64_t attempts = 0;
+    uint64_t successes = 0;
+    uint64_t results = 0;
+    uint64_t nanoseconds = 0;
+};
+
+// Counts of a thread keyed by atom address. Only the owner thread adds
+// counts, mutex is locked by report and clear only.
+struct ProfileTable {
+    std::mutex mutex;
+    std::unordered_map<Atom const*, ProfileEntry> entries;
+};
+
+// Tables are kept after their threads exit and are reused by new threads
+// as trace buffers are
+struct ProfileRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileTable>> tables;
+    std::vector<ProfileTable*> free;
+};
+
+static ProfileRegistry& registry() {
+    static ProfileRegistry* registry = new ProfileRegistry();
+    return *registry;
+}
+
+class ThreadTable {
+public:
+
+    ThreadTable() {
+        ProfileRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.free.empty()) {
+            registry.tables.emplace_back(new ProfileTable());
+            table = registry.tables.back().get();
+        } else {
+            table = registry.free.back();
+            registry.free.pop_back();
+        }
+    }
+
+    ~ThreadTable() {
+        ProfileRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.free.push_back(table);
+    }
+
+    ProfileTable* table;
+};
+
+void profile_atom(AtomPtr const& atom, size_t position, size_t results,
+        uint64_t nanoseconds) {
+    static thread_local ThreadTable thread_table;
+    ProfileTable& table = *thread_table.table;
+    std::lock_guard<std::mutex> lock(table.mutex);
+    ProfileEntry& entry = table.entries[atom.get()];
+    if (!entry.atom) {
+        entry.atom = atom;
+    }
+    entry.position = position;
+    ++entry.attempts;
+    entry.successes += results > 0;
+    entry.results += results;
+    entry.nanoseconds += nanoseconds;
+}
+
+static std::string entry_name(ProfileEntry const& entry) {
+    if (entry.position == NO_POSITION) {
+        return entry.atom->to_string();
+    }
+    return "#" + std::to_string(entry.position) + " " + entry.atom->to_string();
+}
+
+void Profiler::writeReport(std::ostream& out) {
+    // Entries of the same atom counted by different threads are summed,
+    // grounded atoms are summed by name because equal grounded atoms are
+    // often different instances
+    std::map<std::string, ProfileEntry> entries;
+    {
+        ProfileRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto const& table : registry.tables) {
+            std::lock_guard<std::mutex> table_lock(table->mutex);
+            for (auto const& it : table->entries) {
+                ProfileEntry const& entry = it.second;
+                ProfileEntry& sum = entries[entry_name(entry)];
+                sum.atom = entry.atom;
+                sum.position = entry.position;
+                sum.attempts += entry.attempts;
+                sum.successes += entry.successes;
+                sum.results += entry.results;
+                sum.nanoseconds += entry.nanoseconds;
+            }
+        }
+    }
+    std::vector<std::pair<std::string const, ProfileEntry> const*> sorted;
+    for (auto const& entry : entries) {
+        sorted.push_back(&entry);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto const* a, auto const* b) -> bool {
+                return a->second.nanoseconds > b->second.nanoseconds;
+            });
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::setw(12) << "time ms" << std::setw(12) << "attempts" <<
+        std::setw(12) << "successes" << std::setw(12) << "results" <<
+        "  rule or grounded atom" << std::endl;
+    for (auto const* entry : sorted) {
+        ProfileEntry const& counts = entry->second;
+        out << std::fixed << std::setprecision(3) << std::setw(12) <<
+            counts.nanoseconds * 1e-6 << std::setw(12) << counts.attempts <<
+            std::setw(12) << counts.successes << std::setw(12) << counts.results <<
+            "  " << entry->first << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Profiler::clear() {
+    ProfileRegistry& registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto const& table : registry.tables) {
+        std::lock_guard<std::mutex> table_lock(table->mutex);
+        table->entries.clear();
+    }
+}
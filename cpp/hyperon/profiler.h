@@ -0,0 +1,34 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <ostream>
+
+// Counts attempts, successes, results and time of the knowledge base rules
+// unified by the interpreter and of the grounded atoms it executes. Rule
+// attempt is a unification of the rule with a function call, grounded atom
+// attempt is an execution of the grounded expression. Each thread counts
+// into its own table, tables are summed when report is written.
+class Profiler {
+public:
+
+    static void setEnabled(bool enabled) {
+        Profiler::enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Writes rules and grounded atoms sorted by time, most expensive first.
+    // Rules are named by their position in the knowledge base and text.
+    static void writeReport(std::ostream& out);
+    // Drops counts recorded so far and releases the atoms counted
+    static void clear();
+
+private:
+
+    static std::atomic<bool> enabled;
+};
+
+#endif /* PROFILER_H */
@@ -0,0 +1,47 @@
+#ifndef PROFILER_PRIV_H
+#define PROFILER_PRIV_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "profiler.h"
+#include "GroundingSpace.h"
+
+// Position of the grounded atoms which are not in knowledge base
+constexpr size_t NO_POSITION = static_cast<size_t>(-1);
+
+void profile_atom(AtomPtr const& atom, size_t position, size_t results,
+        uint64_t nanoseconds);
+
+// Records the attempt to unify the rule or execute the grounded atom when
+// destroyed if profiling is enabled, attempt succeeds when it has results
+class ProfileScope {
+public:
+
+    ProfileScope(AtomPtr const& atom, size_t position = NO_POSITION)
+        : atom(Profiler::isEnabled() ? &atom : nullptr), position(position) {
+        if (this->atom) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (atom) {
+            profile_atom(*atom, position, results,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    void set_results(size_t results) { this->results = results; }
+
+private:
+
+    AtomPtr const* atom;
+    size_t position;
+    size_t results = 0;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif /* PROFILER_PRIV_H */
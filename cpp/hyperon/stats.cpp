@@ -0,0 +1,223 @@
+#include "stats.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Counters of a single thread. Only the owner thread writes them, so they
+// are updated without read-modify-write operations.
+struct StatsBlock {
+    std::atomic<uint64_t> counters[Stats::COUNTERS];
+    std::atomic<uint64_t> buckets[Stats::HISTOGRAMS][Stats::BUCKETS];
+    std::atomic<uint64_t> nanoseconds[Stats::HISTOGRAMS];
+    // Block is updated by threads whose own block is released
+    bool shared;
+};
+
+// Blocks of finished threads are reused by new threads, so number of
+// blocks is not more than number of threads running at once
+struct StatsRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<StatsBlock>> blocks;
+    std::vector<StatsBlock*> free;
+    StatsBlock shared{};
+    Stats::Snapshot baseline;
+};
+
+static StatsRegistry& registry() {
+    // Registry is never destroyed because atoms can be created after
+    // static objects are destroyed
+    static StatsRegistry* registry = [] {
+        StatsRegistry* registry = new StatsRegistry();
+        registry->shared.shared = true;
+        return registry;
+    }();
+    return *registry;
+}
+
+static thread_local StatsBlock* local_block = nullptr;
+
+class ThreadBlock {
+public:
+
+    ThreadBlock() {
+        StatsRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.free.empty()) {
+            registry.blocks.emplace_back(new StatsBlock());
+            local_block = registry.blocks.back().get();
+        } else {
+            local_block = registry.free.back();
+            registry.free.pop_back();
+        }
+    }
+
+    ~ThreadBlock() {
+        StatsRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.free.push_back(local_block);
+        local_block = &registry.shared;
+    }
+};
+
+static StatsBlock& local() {
+    if (!local_block) {
+        static thread_local ThreadBlock block;
+    }
+    return *local_block;
+}
+
+static void increment(StatsBlock const& block, std::atomic<uint64_t>& value, uint64_t delta) {
+    if (block.shared) {
+        value.fetch_add(delta, std::memory_order_relaxed);
+    } else {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+}
+
+void Stats::add(Counter counter, uint64_t value) {
+    StatsBlock& block = local();
+    increment(block, block.counters[counter], value);
+}
+
+void Stats::record(Histogram histogram, uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (bucket < BUCKETS - 1 && (uint64_t(1000) << bucket) < nanoseconds) {
+        ++bucket;
+    }
+    StatsBlock& block = local();
+    increment(block, block.buckets[histogram][bucket], 1);
+    increment(block, block.nanoseconds[histogram], nanoseconds);
+}
+
+static void add_block(Stats::Snapshot& snapshot, StatsBlock const& block) {
+    for (size_t i = 0; i < Stats::COUNTERS; ++i) {
+        snapshot.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < Stats::HISTOGRAMS; ++i) {
+        for (size_t j = 0; j < Stats::BUCKETS; ++j) {
+            snapshot.buckets[i][j] += block.buckets[i][j].load(std::memory_order_relaxed);
+        }
+        snapshot.nanoseconds[i] += block.nanoseconds[i].load(std::memory_order_relaxed);
+    }
+}
+
+static Stats::Snapshot sum_blocks(StatsRegistry const& registry) {
+    Stats::Snapshot snapshot;
+    for (auto const& block : registry.blocks) {
+        add_block(snapshot, *block);
+    }
+    add_block(snapshot, registry.shared);
+    return snapshot;
+}
+
+Stats::Snapshot Stats::getSnapshot() {
+    StatsRegistry& registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Snapshot snapshot = sum_blocks(registry);
+    for (size_t i = 0; i < COUNTERS; ++i) {
+        snapshot.counters[i] -= registry.baseline.counters[i];
+    }
+    for (size_t i = 0; i < HISTOGRAMS; ++i) {
+        for (size_t j = 0; j < BUCKETS; ++j) {
+            snapshot.buckets[i][j] -= registry.baseline.buckets[i][j];
+        }
+        snapshot.nanoseconds[i] -= registry.baseline.nanoseconds[i];
+    }
+    return snapshot;
+}
+
+Stats::Snapshot Stats::getTotals() {
+    StatsRegistry& registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return sum_blocks(registry);
+}
+
+void Stats::reset() {
+    StatsRegistry& registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.baseline = sum_blocks(registry);
+}
+
+char const* Stats::getName(Counter counter) {
+    static char const* names[] = { "candidates_scanned", "candidates_matched",
+        "bindings_created", "atoms_allocated", "interpreter_steps", "grounded_calls" };
+    return names[counter];
+}
+
+char const* Stats::getName(Histogram histogram) {
+    static char const* names[] = { "match_latency", "interpret_latency" };
+    return names[histogram];
+}
+
+void Stats::writePrometheus(std::ostream& out) {
+    Snapshot snapshot = getTotals();
+    for (size_t i = 0; i < COUNTERS; ++i) {
+        std::string name = std::string("hyperon_") + getName(static_cast<Counter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n";
+        out << name << " " << snapshot.counters[i] << "\n";
+    }
+    for (size_t i = 0; i < HISTOGRAMS; ++i) {
+        std::string name = std::string("hyperon_") + getName(static_cast<Histogram>(i)) + "_seconds";
+        out << "# TYPE " << name << " histogram\n";
+        uint64_t count = 0;
+        for (size_t j = 0; j < BUCKETS; ++j) {
+            count += snapshot.buckets[i][j];
+            out << name << "_bucket{le=\"";
+            if (j < BUCKETS - 1) {
+                out << (uint64_t(1) << j) * 1e-6;
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << count << "\n";
+        }
+        out << name << "_sum " << snapshot.nanoseconds[i] * 1e-9 << "\n";
+        out << name << "_count " << count << "\n";
+    }
+}
+
+// Escapes label value as Prometheus text format requires
+static std::string escape_label(std::string const& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void write_prometheus(std::ostream& out,
+        std::vector<std::pair<std::string, SpaceStats>> const& spaces) {
+    struct Metric {
+        char const* name;
+        char const* type;
+        uint64_t SpaceStats::* value;
+    };
+    static Metric const metrics[] = {
+        { "queries_total", "counter", &SpaceStats::queries },
+        { "candidates_scanned_total", "counter", &SpaceStats::candidates_scanned },
+        { "candidates_matched_total", "counter", &SpaceStats::candidates_matched },
+        { "size", "gauge", &SpaceStats::size },
+    };
+    for (auto const& metric : metrics) {
+        std::string name = std::string("hyperon_space_") + metric.name;
+        out << "# TYPE " << name << " " << metric.type << "\n";
+        for (auto const& space : spaces) {
+            out << name << "{space=\"" << escape_label(space.first) << "\"} " <<
+                space.second.*metric.value << "\n";
+        }
+    }
+}
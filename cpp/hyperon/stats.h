@@ -0,0 +1,109 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counters and latency histograms of the engine. Each thread updates its
+// own counters, counters of all threads are summed when snapshot is taken.
+class Stats {
+public:
+
+    enum Counter {
+        CANDIDATES_SCANNED,
+        CANDIDATES_MATCHED,
+        BINDINGS_CREATED,
+        ATOMS_ALLOCATED,
+        INTERPRETER_STEPS,
+        GROUNDED_CALLS,
+        COUNTERS
+    };
+
+    enum Histogram {
+        MATCH_LATENCY,
+        INTERPRET_LATENCY,
+        HISTOGRAMS
+    };
+
+    // Bucket i counts samples not longer than 2^i microseconds, the last
+    // bucket counts longer samples
+    static constexpr size_t BUCKETS = 22;
+
+    struct Snapshot {
+        uint64_t counters[COUNTERS] = {};
+        uint64_t buckets[HISTOGRAMS][BUCKETS] = {};
+        uint64_t nanoseconds[HISTOGRAMS] = {};
+    };
+
+    // Records time from creation to destruction into histogram
+    class Timer {
+    public:
+        Timer(Histogram histogram) : histogram(histogram),
+            start(std::chrono::steady_clock::now()) { }
+        ~Timer() {
+            record(histogram, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+    private:
+        Histogram histogram;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static void add(Counter counter, uint64_t value = 1);
+    static void record(Histogram histogram, uint64_t nanoseconds);
+    // Called by each atom constructor, so ATOMS_ALLOCATED is counted only
+    // when it is enabled by setAtomCounting()
+    static void addAtom() {
+        if (atom_counting.load(std::memory_order_relaxed)) {
+            add(ATOMS_ALLOCATED);
+        }
+    }
+    static void setAtomCounting(bool enabled) {
+        atom_counting.store(enabled, std::memory_order_relaxed);
+    }
+    // Returns counts since the last reset() call
+    static Snapshot getSnapshot();
+    // Returns counts since the start of the process, they are not changed
+    // by reset()
+    static Snapshot getTotals();
+    // Counts getSnapshot() from zero again
+    static void reset();
+
+    static char const* getName(Counter counter);
+    static char const* getName(Histogram histogram);
+    // Writes getTotals() as Prometheus counters and histograms, which
+    // should never decrease
+    static void writePrometheus(std::ostream& out);
+
+private:
+    static inline std::atomic<bool> atom_counting{false};
+};
+
+// Statistics of a single GroundingSpace, queries of its published versions
+// are counted as queries of the space
+struct SpaceStats {
+    // match and unify calls
+    uint64_t queries;
+    uint64_t candidates_scanned;
+    uint64_t candidates_matched;
+    // Number of atoms, for the space interpreted by interpret_step() it is
+    // the number of expressions left to evaluate
+    uint64_t size;
+};
+
+// Writes statistics of the spaces labeled by the space name: query counts
+// as Prometheus counters and size as a gauge. Each metric is written once
+// for all spaces, so spaces should be written by a single call.
+void write_prometheus(std::ostream& out,
+        std::vector<std::pair<std::string, SpaceStats>> const& spaces);
+inline void write_prometheus(std::ostream& out, std::string const& space, SpaceStats const& stats) {
+    write_prometheus(out, { { space, stats } });
+}
+
+#endif /* STATS_H */
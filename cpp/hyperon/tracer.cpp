@@ -0,0 +1,155 @@
+#include "tracer_priv.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled{false};
+
+// Ring buffer of the events of a thread. Only the owner thread writes
+// events, fields are atomic so events can be read while they are written:
+// the buffer is a sequence lock, reader drops events which could be
+// overwritten while it read them.
+struct TraceBuffer {
+    static constexpr uint64_t CAPACITY = 1 << 14;
+
+    struct Event {
+        std::atomic<char const*> name;
+        // nanoseconds shifted left, lowest bit is set for begin events
+        std::atomic<uint64_t> time;
+        std::atomic<uint32_t> tid;
+    };
+
+    // Twice the number of written events, odd while the next event is
+    // written
+    std::atomic<uint64_t> sequence{0};
+    // events before it are cleared
+    std::atomic<uint64_t> first{0};
+    Event events[CAPACITY];
+};
+
+// Buffers are kept after their threads exit, so events of finished threads
+// can be written. Buffer of the finished thread is reused by the next new
+// thread, so number of buffers is not more than number of threads running
+// at once.
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::vector<TraceBuffer*> free;
+    uint32_t next_tid = 1;
+};
+
+static TraceRegistry& registry() {
+    // Registry is never destroyed because threads can release buffers
+    // after static objects are destroyed
+    static TraceRegistry* registry = new TraceRegistry();
+    return *registry;
+}
+
+class ThreadBuffer {
+public:
+
+    ThreadBuffer() {
+        TraceRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        tid = registry.next_tid++;
+        if (registry.free.empty()) {
+            registry.buffers.emplace_back(new TraceBuffer());
+            buffer = registry.buffers.back().get();
+        } else {
+            buffer = registry.free.back();
+            registry.free.pop_back();
+        }
+    }
+
+    ~ThreadBuffer() {
+        TraceRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.free.push_back(buffer);
+    }
+
+    TraceBuffer* buffer;
+    uint32_t tid;
+};
+
+static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_event(char const* name, bool begin) {
+    static thread_local ThreadBuffer local;
+    TraceBuffer& buffer = *local.buffer;
+    uint64_t sequence = buffer.sequence.load(std::memory_order_relaxed);
+    TraceBuffer::Event& event = buffer.events[(sequence >> 1) % TraceBuffer::CAPACITY];
+    // reader which sees any of the fields written below sees the odd
+    // sequence after its acquire fence
+    buffer.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.time.store(now() << 1 | (begin ? 1 : 0), std::memory_order_relaxed);
+    event.tid.store(local.tid, std::memory_order_relaxed);
+    buffer.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+struct TraceEvent {
+    char const* name;
+    uint64_t time;
+    uint32_t tid;
+};
+
+static void read_events(TraceBuffer const& buffer, std::vector<TraceEvent>& events) {
+    // events before the head are written completely
+    uint64_t head = buffer.sequence.load(std::memory_order_acquire) >> 1;
+    uint64_t begin = std::max(buffer.first.load(std::memory_order_relaxed),
+            head > TraceBuffer::CAPACITY ? head - TraceBuffer::CAPACITY : 0);
+    size_t read = events.size();
+    for (uint64_t i = begin; i < head; ++i) {
+        TraceBuffer::Event const& event = buffer.events[i % TraceBuffer::CAPACITY];
+        events.push_back({ event.name.load(std::memory_order_relaxed),
+                event.time.load(std::memory_order_relaxed),
+                event.tid.load(std::memory_order_relaxed) });
+    }
+    // events which are overwritten or being overwritten by the writer after
+    // the head is read are dropped, started counts the event being written
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t started = (buffer.sequence.load(std::memory_order_relaxed) + 1) >> 1;
+    if (started > begin + TraceBuffer::CAPACITY) {
+        size_t overwritten = std::min(started - TraceBuffer::CAPACITY, head) - begin;
+        events.erase(events.begin() + read, events.begin() + read + overwritten);
+    }
+}
+
+void Tracer::writeChromeTrace(std::ostream& out) {
+    std::vector<TraceEvent> events;
+    {
+        TraceRegistry& registry = ::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto const& buffer : registry.buffers) {
+            read_events(*buffer, events);
+        }
+    }
+    std::ios_base::fmtflags flags = out.flags();
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        TraceEvent const& event = events[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name <<
+            "\",\"ph\":\"" << (event.time & 1 ? "B" : "E") <<
+            "\",\"ts\":" << std::fixed << std::setprecision(3) << (event.time >> 1) / 1000.0 <<
+            ",\"pid\":1,\"tid\":" << event.tid << "}";
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+}
+
+void Tracer::clear() {
+    TraceRegistry& registry = ::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto const& buffer : registry.buffers) {
+        buffer->first.store(buffer->sequence.load(std::memory_order_acquire) >> 1,
+                std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <ostream>
+
+// Records begin and end events of interpreter steps, matching,
+// unification, grounded atom execution and rule application. Each thread
+// records events into its own ring buffer, the oldest events are
+// overwritten when buffer is full. Events are written in Chrome trace event
+// format which can be opened by chrome://tracing or Perfetto.
+class Tracer {
+public:
+
+    static void setEnabled(bool enabled) {
+        Tracer::enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Writes events recorded so far, can be called while other threads
+    // record events
+    static void writeChromeTrace(std::ostream& out);
+    // Drops events recorded so far
+    static void clear();
+
+private:
+
+    static std::atomic<bool> enabled;
+};
+
+#endif /* TRACER_H */
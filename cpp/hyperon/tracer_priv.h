@@ -0,0 +1,32 @@
+#ifndef TRACER_PRIV_H
+#define TRACER_PRIV_H
+
+#include "tracer.h"
+
+void trace_event(char const* name, bool begin);
+
+// Records begin event when created and end event when destroyed if tracing
+// is enabled, name should be a string literal
+class TraceScope {
+public:
+
+    TraceScope(char const* name) : name(Tracer::isEnabled() ? name : nullptr) {
+        if (this->name) {
+            trace_event(this->name, true);
+        }
+    }
+
+    ~TraceScope() {
+        if (name) {
+            trace_event(name, false);
+        }
+    }
+
+private:
+
+    char const* name;
+};
+
+#define TRACE_SCOPE(name) TraceScope trace_scope(name)
+
+#endif /* TRACER_PRIV_H */
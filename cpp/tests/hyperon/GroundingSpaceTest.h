@@ -1,5 +1,9 @@
 #include <cxxtest/TestSuite.h>
 
+#include <thread>
+#include <atomic>
+#include <sstream>
+
 #include <hyperon/hyperon.h>
 #include <hyperon/common/common.h>
 
@@ -15,6 +19,25 @@ void add_factorial_definition(GroundingSpace& kb) {
                                 V("n") }) }) }));
 }
 
+class DoubleAtom : public GroundedAtom {
+public:
+    void execute(GroundingSpace const& args, GroundingSpace& result) const override {
+        AtomPtr arg = args.get_content()[1];
+        result.add_atom(E({ arg, arg }));
+    }
+    bool operator==(Atom const& other) const override { return this == &other; }
+    std::string to_string() const override { return "double"; }
+};
+
+// Counts to_string() calls to check that disabled log messages are not
+// formatted
+class CountingAtom : public GroundedAtom {
+public:
+    bool operator==(Atom const& other) const override { return this == &other; }
+    std::string to_string() const override { ++calls; return "counting"; }
+    mutable int calls = 0;
+};
+
 class GroundingSpaceTest : public CxxTest::TestSuite {
 public:
 
@@ -28,6 +51,40 @@ public:
         TS_ASSERT(*atom == *E({S("="), V("a"), S("0")}));
     }
 
+    void test_symbol_atom_is_interned() {
+        TS_ASSERT_EQUALS(S("isa"), S("isa"));
+        TS_ASSERT_EQUALS(SymbolAtom("isa").get_id(), S("isa")->get_id());
+        TS_ASSERT(SymbolAtom("isa") == *S("isa"));
+        TS_ASSERT(*S("isa") != *S("is"));
+    }
+
+    void test_hash_consing_returns_canonical_expression() {
+        ExprTable::instance().set_enabled(true);
+        ExprAtomPtr a = E({ S("isa"), E({ S("red"), V("x") }), S("color") });
+        ExprAtomPtr b = E({ S("isa"), E({ S("red"), V("x") }), S("color") });
+        ExprTable::instance().set_enabled(false);
+
+        TS_ASSERT_EQUALS(a, b);
+        TS_ASSERT(a->is_frozen());
+        TS_ASSERT_THROWS(a->set_child(0, S("is")), std::logic_error const&);
+        AtomPtr c = E({ S("isa"), E({ S("red"), V("x") }), S("color") });
+        TS_ASSERT(*a == *c);
+        TS_ASSERT_EQUALS(a->hash(), c->hash());
+    }
+
+    void test_hash_consing_doesnt_modify_children() {
+        ExprAtomPtr child = E({ S("red"), V("x") });
+        ExprTable::instance().set_enabled(true);
+        ExprAtomPtr a = E({ S("isa"), child, S("color") });
+        ExprAtomPtr b = E({ S("red"), V("x") });
+        ExprTable::instance().set_enabled(false);
+
+        TS_ASSERT(!child->is_frozen());
+        TS_ASSERT(a->get_children()[1] != child);
+        TS_ASSERT_EQUALS(a->get_children()[1], b);
+        TS_ASSERT(*a->get_children()[1] == *child);
+    }
+
     void test_match_function_definition() {
         GroundingSpace kb;
         kb.add_atom(E({ S(":-"), E({ S("fact"), S("0") }), S("1") }));
@@ -64,6 +121,187 @@ public:
         TS_ASSERT(expected == result);
     }
 
+    void test_match_uses_index_and_keeps_content_order() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("isa"), S("kitchen-lamp"), S("lamp") }));
+        kb.add_atom(E({ S("color"), S("kitchen-lamp"), S("white") }));
+        kb.add_atom(E({ V("y"), S("ceiling-lamp"), S("lamp") }));
+        kb.add_atom(E({ S("isa"), S("bedroom-lamp") }));
+        kb.add_atom(V("z"));
+        kb.add_atom(E({ S("isa"), S("bedroom-lamp"), S("lamp") }));
+        GroundingSpace pattern;
+        pattern.add_atom(E({ S("isa"), V("x"), S("lamp") }));
+        GroundingSpace templ;
+        templ.add_atom(V("x"));
+
+        GroundingSpace result;
+        kb.match(pattern, templ, result);
+
+        GroundingSpace expected;
+        expected.add_atom(S("kitchen-lamp"));
+        expected.add_atom(S("ceiling-lamp"));
+        expected.add_atom(V("x"));
+        expected.add_atom(S("bedroom-lamp"));
+        TS_ASSERT(expected == result);
+    }
+
+    void test_unify_uses_rule_argument_index() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("="), E({ S("color"), S("a") }), S("red") }));
+        kb.add_atom(E({ S("="), E({ S("color"), S("b") }), S("green") }));
+        kb.add_atom(E({ S("color"), S("b") }));
+        kb.add_atom(E({ S("="), E({ S("color"), V("x") }), S("black") }));
+
+        std::vector<UnificationResult> results = kb.unify(
+                E({ S("="), E({ S("color"), S("b") }), V("y") }));
+        TS_ASSERT_EQUALS(results.size(), 2);
+        TS_ASSERT(*S("green") == *results[0].b_bindings[V("y")]);
+        TS_ASSERT(*S("black") == *results[1].b_bindings[V("y")]);
+
+        kb.add_atom(E({ S("="), E({ S("color"), S("b") }), S("blue") }));
+        results = kb.unify(E({ S("="), E({ S("color"), S("b") }), V("y") }));
+        TS_ASSERT_EQUALS(results.size(), 3);
+        TS_ASSERT(*S("blue") == *results[2].b_bindings[V("y")]);
+    }
+
+    void test_match_same_variable_twice() {
+        TS_ASSERT_EQUALS(V("x")->get_id(), VariableAtom("x").get_id());
+        GroundingSpace kb;
+        kb.add_atom(E({ S("eq"), S("a"), S("b") }));
+        kb.add_atom(E({ S("eq"), S("c"), S("c") }));
+
+        std::vector<Bindings> results = kb.match(E({ S("eq"), V("x"), V("x") }));
+
+        TS_ASSERT_EQUALS(results.size(), 1);
+        TS_ASSERT_EQUALS(results[0].size(), 1);
+        TS_ASSERT(*S("c") == *results[0][V("x")]);
+    }
+
+    void test_interpret_renames_rule_variables_apart() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("="), E({ S("pair"), V("x") }),
+                    E({ S("::"), V("x"), V("y") }) }));
+        GroundingSpace target;
+        target.add_atom(E({ S("pair"), V("y") }));
+
+        AtomPtr result = interpret_until_result(target, kb);
+
+        TS_ASSERT_EQUALS(result->get_type(), Atom::EXPR);
+        auto const& children = std::static_pointer_cast<ExprAtom>(result)->get_children();
+        TS_ASSERT(*V("y") == *children[1]);
+        TS_ASSERT_EQUALS(children[2]->get_type(), Atom::VARIABLE);
+        TS_ASSERT(*V("y") != *children[2]);
+        TS_ASSERT(*VariableAtom::unique("y") != *VariableAtom::unique("y"));
+    }
+
+    void test_match_cursor_limit_exists_count() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("isa"), S("kitchen-lamp"), S("lamp") }));
+        kb.add_atom(E({ S("isa"), S("bedroom-lamp"), S("lamp") }));
+        kb.add_atom(E({ S("isa"), S("Fred"), S("frog") }));
+        AtomPtr pattern = E({ S("isa"), V("x"), S("lamp") });
+
+        MatchCursor cursor = kb.match_cursor(pattern);
+        Bindings bindings;
+        TS_ASSERT(cursor.next(bindings));
+        TS_ASSERT(*S("kitchen-lamp") == *bindings[V("x")]);
+        kb.add_atom(E({ S("isa"), S("hall-lamp"), S("lamp") }));
+        TS_ASSERT(cursor.next(bindings));
+        TS_ASSERT(*S("bedroom-lamp") == *bindings[V("x")]);
+        TS_ASSERT(!cursor.next(bindings));
+
+        std::vector<Bindings> first = kb.match(pattern, 1);
+        TS_ASSERT_EQUALS(first.size(), 1);
+        TS_ASSERT(*S("kitchen-lamp") == *first[0][V("x")]);
+        TS_ASSERT_EQUALS(kb.count(pattern), 3);
+        TS_ASSERT(kb.exists(E({ S("isa"), V("x"), S("frog") })));
+        TS_ASSERT(!kb.exists(E({ S("isa"), V("x"), S("toad") })));
+    }
+
+    void test_match_cursor_survives_changes_of_space() {
+        GroundingSpace kb;
+        for (int i = 0; i < 10; ++i) {
+            kb.add_atom(E({ S("isa"), S("lamp" + std::to_string(i)), S("lamp") }));
+        }
+        AtomPtr pattern = E({ S("isa"), V("x"), S("lamp") });
+
+        MatchCursor cursor = kb.match_cursor(pattern);
+        Bindings bindings;
+        TS_ASSERT(cursor.next(bindings));
+        TS_ASSERT(*S("lamp0") == *bindings[V("x")]);
+        // removing more than half of the content compacts it
+        for (int i = 0; i < 6; ++i) {
+            kb.remove_atom(E({ S("isa"), S("lamp" + std::to_string(i)), S("lamp") }));
+        }
+        kb.publish();
+        kb.add_atom(E({ S("isa"), S("hall-lamp"), S("lamp") }));
+        kb.publish();
+
+        std::vector<AtomPtr> rest;
+        while (cursor.next(bindings)) {
+            rest.push_back(bindings[V("x")]);
+        }
+        TS_ASSERT(rest == std::vector<AtomPtr>({ S("lamp6"), S("lamp7"), S("lamp8"), S("lamp9") }));
+        TS_ASSERT_EQUALS(kb.count(pattern), 5);
+    }
+
+    void test_match_conjunction() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("isa"), S("lamp1"), S("lamp") }));
+        kb.add_atom(E({ S("isa"), S("lamp2"), S("lamp") }));
+        kb.add_atom(E({ S("isa"), S("lamp3"), S("lamp") }));
+        kb.add_atom(E({ S("in"), S("lamp2"), S("kitchen") }));
+        kb.add_atom(E({ S("in"), S("lamp3"), S("hall") }));
+        kb.add_atom(E({ S("in"), S("lamp1"), S("kitchen") }));
+        kb.add_atom(E({ S("state"), S("lamp2"), S("on") }));
+        kb.add_atom(E({ S("state"), S("lamp1"), S("on") }));
+        GroundingSpace pattern;
+        pattern.add_atom(E({ S("isa"), V("x"), S("lamp") }));
+        pattern.add_atom(E({ S("in"), V("x"), S("kitchen") }));
+        pattern.add_atom(E({ S("state"), V("x"), S("on") }));
+        GroundingSpace templ;
+        templ.add_atom(V("x"));
+
+        GroundingSpace result;
+        kb.match(pattern, templ, result);
+
+        GroundingSpace expected;
+        expected.add_atom(S("lamp1"));
+        expected.add_atom(S("lamp2"));
+        TS_ASSERT(expected == result);
+    }
+
+    void test_match_conjunction_with_variables_in_space() {
+        GroundingSpace kb;
+        kb.add_atom(E({ S("isa"), S("Fred"), S("frog") }));
+        kb.add_atom(E({ S("isa"), S("frog"), S("green") }));
+        kb.add_atom(E({ S("isa"), V("t"), S("thing") }));
+        GroundingSpace pattern;
+        pattern.add_atom(E({ S("isa"), V("x"), V("y") }));
+        pattern.add_atom(E({ S("isa"), V("y"), V("z") }));
+        GroundingSpace templ;
+        templ.add_atom(E({ S("isa"), V("x"), V("z") }));
+
+        GroundingSpace result;
+        kb.match(pattern, templ, result);
+
+        GroundingSpace expected;
+        expected.add_atom(E({ S("isa"), S("Fred"), S("green") }));
+        expected.add_atom(E({ S("isa"), S("Fred"), S("thing") }));
+        expected.add_atom(E({ S("isa"), S("frog"), S("thing") }));
+        expected.add_atom(E({ S("isa"), V("t"), S("thing") }));
+        TS_ASSERT_EQUALS(expected.to_string(), result.to_string());
+    }
+
+    void test_interpret_grounded_atom_executed_using_grounding_space() {
+        GroundingSpace target;
+        target.add_atom(E({ std::make_shared<DoubleAtom>(), S("a") }));
+
+        AtomPtr result = interpret_until_result(target, GroundingSpace());
+
+        TS_ASSERT(*E({ S("a"), S("a") }) == *result);
+    }
+
     void test_interpret_plain_expr() {
         GroundingSpace kb;
         add_factorial_definition(kb);
@@ -102,6 +340,660 @@ public:
         TS_ASSERT(*S("True") == *result);
     }
 
+    void test_interpret_parallel_keeps_order_of_interpret_step() {
+        Atomese atomese;
+        GroundingSpace kb, target, parallel;
+        atomese.parse("(= (bin) 0) (= (bin) 1) (= (pair) (:: (bin) (bin)))", kb);
+        atomese.parse("(= (sum (:: $a $b)) (+ $a $b))", kb);
+        add_factorial_definition(kb);
+        atomese.parse("(sum (pair)) (pair)", target);
+        target.add_atom(E({ S("fact"), Int(5) }));
+        atomese.parse("(sum (pair)) (pair)", parallel);
+        parallel.add_atom(E({ S("fact"), Int(5) }));
+
+        std::vector<AtomPtr> expected;
+        AtomPtr result;
+        while (*(result = interpret_until_result(target, kb)) != *S("eos")) {
+            expected.push_back(result);
+        }
+        std::vector<AtomPtr> results = parallel.interpret_parallel(kb, 4);
+
+        TS_ASSERT_EQUALS(expected.size(), 9);
+        TS_ASSERT(results == expected);
+        TS_ASSERT(parallel.get_content().empty());
+        parallel.add_atom(E({ S("fact"), Int(5) }));
+        results = parallel.interpret_parallel(kb, 4, false);
+        TS_ASSERT_EQUALS(results.size(), 1);
+        TS_ASSERT(*Int(120) == *results[0]);
+    }
+
+    void test_interpreter_returns_results_of_interpret_step() {
+        Atomese atomese;
+        GroundingSpace kb, target;
+        atomese.parse("(= (bin) 0) (= (bin) 1) (= (pair) (:: (bin) (bin)))", kb);
+        atomese.parse("(= (sum (:: $a $b)) (+ $a $b))", kb);
+        atomese.parse("(= (len nil) 0) (= (len (:: $x $xs)) (+ 1 (len $xs)))", kb);
+        atomese.parse("(= (inc Z) (S Z)) (= (inc (S $x)) (S (inc $x)))", kb);
+        atomese.parse("(= (isa Fred frog) True) (= (croaks Fred) True)", kb);
+        add_factorial_definition(kb);
+        std::string program = "(sum (pair)) (pair) (len (:: 1 (:: 2 nil)))"
+            " (inc Z) (isa $x frog) (if (croaks $y) (isa $y $z) False)";
+        atomese.parse(program, target);
+        target.add_atom(E({ S("fact"), Int(5) }));
+        Interpreter interpreter(kb);
+        for (auto const& atom : target.get_content()) {
+            interpreter.add_atom(atom);
+        }
+
+        std::vector<AtomPtr> expected;
+        AtomPtr result;
+        while (*(result = interpret_until_result(target, kb)) != *S("eos")) {
+            expected.push_back(result);
+        }
+        std::vector<AtomPtr> results;
+        while (*(result = interpret_until_result(interpreter)) != *S("eos")) {
+            results.push_back(result);
+        }
+
+        TS_ASSERT_EQUALS(expected.size(), 12);
+        TS_ASSERT_EQUALS(to_string(results, " "), to_string(expected, " "));
+        TS_ASSERT(interpreter.empty());
+    }
+
+    void test_interpreter_answers_tabled_calls_from_table() {
+        GroundingSpace kb;
+        add_factorial_definition(kb);
+        kb.add_atom(E({ S("="), E({ S("fib"), V("n") }),
+                    E({ S("if"), E({ EQ, V("n"), Int(0) }), Int(0),
+                        E({ S("if"), E({ EQ, V("n"), Int(1) }), Int(1),
+                            E({ ADD, E({ S("fib"), E({ SUB, V("n"), Int(1) }) }),
+                                E({ S("fib"), E({ SUB, V("n"), Int(2) }) }) }) }) }) }));
+        auto interpret = [&kb](AtomPtr atom, AnswerTable* table, int& steps) -> AtomPtr {
+            Interpreter interpreter(kb, table);
+            interpreter.add_atom(atom);
+            AtomPtr result;
+            for (steps = 1; (result = interpreter.step()) == Atom::INVALID; ++steps);
+            return result;
+        };
+        AnswerTable table;
+        table.add_head(S("fib"));
+        int steps, tabled_steps;
+
+        AtomPtr expected = interpret(E({ S("fib"), Int(12) }), nullptr, steps);
+        AtomPtr result = interpret(E({ S("fib"), Int(12) }), &table, tabled_steps);
+
+        TS_ASSERT(*Int(144) == *expected);
+        TS_ASSERT(*expected == *result);
+        TS_ASSERT_EQUALS(table.size(), 13);
+        interpret(E({ S("fib"), Int(12) }), &table, tabled_steps);
+        TS_ASSERT_EQUALS(tabled_steps, 2);
+
+        kb.add_atom(E({ S("="), E({ S("fib"), Int(20) }), Int(0) }));
+        interpret(E({ S("fib"), Int(3) }), &table, tabled_steps);
+        TS_ASSERT_EQUALS(table.size(), 4);
+
+        AnswerTable small(3);
+        small.add_head(S("fib"));
+        result = interpret(E({ S("fib"), Int(12) }), &small, tabled_steps);
+        TS_ASSERT(*Int(144) == *result);
+        TS_ASSERT_EQUALS(small.answers(), 3);
+    }
+
+    void test_interpreter_evaluates_deep_recursion_of_tabled_calls() {
+        size_t const depth = 20000;
+        GroundingSpace kb;
+        kb.add_atom(E({ S("="), E({ S("depth"), S("s0") }), Int(0) }));
+        for (size_t i = 1; i <= depth; ++i) {
+            kb.add_atom(E({ S("="), E({ S("depth"), S("s" + std::to_string(i)) }),
+                        E({ ADD, Int(1), E({ S("depth"), S("s" + std::to_string(i - 1)) }) }) }));
+        }
+        AnswerTable table;
+        table.add_head(S("depth"));
+        Interpreter interpreter(kb, &table);
+        interpreter.add_atom(E({ S("depth"), S("s" + std::to_string(depth)) }));
+
+        AtomPtr result = interpret_until_result(interpreter);
+
+        TS_ASSERT(*Int(depth) == *result);
+        TS_ASSERT(*S("eos") == *interpret_until_result(interpreter));
+        TS_ASSERT_EQUALS(table.size(), depth + 1);
+    }
+
+    void test_interpreter_answers_tabled_calls_with_variables() {
+        Atomese atomese;
+        GroundingSpace kb;
+        atomese.parse("(= (color apple) red) (= (color $x) green)", kb);
+        AnswerTable table;
+        table.add_head(S("color"));
+        std::vector<AtomPtr> results;
+        for (auto const& program : { "(color $a)", "(color $b)" }) {
+            GroundingSpace target;
+            atomese.parse(program, target);
+            Interpreter interpreter(kb, &table);
+            interpreter.add_atom(target.get_content()[0]);
+            AtomPtr result;
+            while (*(result = interpret_until_result(interpreter)) != *S("eos")) {
+                results.push_back(result);
+            }
+        }
+
+        TS_ASSERT_EQUALS(to_string(results, " "), "green red green red");
+        TS_ASSERT_EQUALS(table.size(), 1);
+    }
+
+    void test_compiled_rules_give_same_results() {
+        auto results_to_string = [](std::vector<UnificationResult> const& results) {
+            std::string str;
+            for (auto const& result : results) {
+                for (auto const& binding : result.b_bindings) {
+                    str += binding.first->to_string() + "=" + binding.second->to_string() + " ";
+                }
+                for (auto const& unification : result.unifications) {
+                    str += unification.a->to_string() + "~" + unification.b->to_string() + " ";
+                }
+                str += "; ";
+            }
+            return str;
+        };
+        Atomese atomese;
+        GroundingSpace kb, compiled, target;
+        std::string rules = "(= (color a) red) (= (color $x) $x) (color b)"
+            " (= (pair $x) (:: $x $y)) (= (eq $x $x) True)"
+            " (= (len nil) 0) (= (len (:: $x $xs)) (+ 1 (len $xs)))";
+        atomese.parse(rules, kb);
+        compiled.compile_rules();
+        atomese.parse(rules, compiled);
+        for (auto const& call : { "(color (pick))", "(color $c)", "(pair $y)",
+                "(eq (f $a) (f b))", "(eq $a $b)", "(len (:: 1 $t))" }) {
+            GroundingSpace query;
+            atomese.parse(std::string("(= ") + call + " $r)", query);
+            AtomPtr atom = query.get_content()[0];
+            TS_ASSERT_EQUALS(results_to_string(compiled.unify(atom)),
+                    results_to_string(kb.unify(atom)));
+        }
+
+        atomese.parse("(= (bin) 0) (= (bin) 1) (= (pair) (:: (bin) (bin)))", compiled);
+        atomese.parse("(= (sum (:: $a $b)) (+ $a $b))", compiled);
+        add_factorial_definition(compiled);
+        atomese.parse("(sum (pair)) (len (:: 1 (:: 2 nil)))", target);
+        target.add_atom(E({ S("fact"), Int(5) }));
+        std::vector<AtomPtr> results;
+        AtomPtr result;
+        while (*(result = interpret_until_result(target, compiled)) != *S("eos")) {
+            results.push_back(result);
+        }
+        TS_ASSERT_EQUALS(to_string(results, " "), "120 2 2 1 1 0");
+    }
+
+    void test_query_shared_kb_from_many_threads() {
+        Atomese atomese;
+        GroundingSpace kb, compiled;
+        compiled.compile_rules();
+        for (GroundingSpace* space : { &kb, &compiled }) {
+            atomese.parse("(= (bin) 0) (= (bin) 1) (= (pair) (:: (bin) (bin)))", *space);
+            atomese.parse("(= (sum (:: $a $b)) (+ $a $b))", *space);
+            atomese.parse("(= (len nil) 0) (= (len (:: $x $xs)) (+ 1 (len $xs)))", *space);
+            atomese.parse("(isa Fred frog) (isa Sam frog) (croaks Fred)", *space);
+            add_factorial_definition(*space);
+        }
+        GroundingSpace program;
+        atomese.parse("(sum (pair)) (len (:: 1 (:: 2 nil))) (fact 6)", program);
+        auto query = [&program](GroundingSpace const& kb) -> std::string {
+            GroundingSpace target(program.get_content());
+            std::vector<AtomPtr> results;
+            AtomPtr result;
+            while (*(result = interpret_until_result(target, kb)) != *S("eos")) {
+                results.push_back(result);
+            }
+            Interpreter interpreter(kb);
+            interpreter.add_atom(E({ S("fact"), Int(5) }));
+            results.push_back(interpret_until_result(interpreter));
+            for (auto const& bindings : kb.match({ E({ S("isa"), V("x"), S("frog") }),
+                        E({ S("croaks"), V("x") }) })) {
+                results.push_back(bindings.at(V("x")));
+            }
+            results.push_back(Int(kb.count(E({ S("isa"), V("x"), V("y") }))));
+            return to_string(results, " ");
+        };
+        std::string expected = query(kb);
+        TS_ASSERT_EQUALS(expected, "720 2 2 1 1 0 120 Fred 2");
+        TS_ASSERT_EQUALS(query(compiled), expected);
+
+        Logger::Level level = Logger::getLevel();
+        Logger::setLevel(Logger::ERROR);
+        std::vector<std::thread> threads;
+        std::vector<std::string> results(8);
+        for (size_t i = 0; i < results.size(); ++i) {
+            threads.emplace_back([&query, &expected, &results, &kb, &compiled, i]() -> void {
+                for (int j = 0; j < 20 && results[i].empty(); ++j) {
+                    for (GroundingSpace const* space : { &kb, &compiled }) {
+                        std::string result = query(*space);
+                        if (result != expected) {
+                            results[i] = result;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        Logger::setLevel(level);
+
+        for (auto const& result : results) {
+            TS_ASSERT_EQUALS(result, "");
+        }
+    }
+
+    void test_published_version_is_not_changed_by_writer() {
+        Atomese atomese;
+        GroundingSpace kb;
+        TS_ASSERT_EQUALS(kb.snapshot()->size(), 0);
+        atomese.parse("(= (bin) 0) (= (bin) 1) (isa Fred frog)", kb);
+        kb.publish();
+        std::shared_ptr<GroundingSpace const> first = kb.snapshot();
+        GroundingSpace plain;
+        for (int i = 0; i < 100; ++i) {
+            kb.add_atom(E({ S("isa"), Int(i), S("frog") }));
+            plain.add_atom(E({ S("isa"), Int(i), S("frog") }));
+            if (i % 7 == 0) {
+                kb.publish();
+            }
+        }
+        kb.compile_rules();
+        atomese.parse("(= (bin) 2)", kb);
+        TS_ASSERT_EQUALS(kb.snapshot()->size(), 102);
+        kb.publish();
+        std::shared_ptr<GroundingSpace const> last = kb.snapshot();
+
+        TS_ASSERT_EQUALS(first->to_string(), "<(= (bin) 0), (= (bin) 1), (isa Fred frog)>");
+        TS_ASSERT_EQUALS(first->count(E({ S("isa"), V("x"), S("frog") })), 1);
+        TS_ASSERT_EQUALS(first->unify(E({ S("="), E({ S("bin") }), V("x") })).size(), 2);
+        TS_ASSERT_EQUALS(last->size(), 104);
+        TS_ASSERT_EQUALS(last->count(E({ S("isa"), V("x"), S("frog") })), 101);
+        TS_ASSERT_EQUALS(last->unify(E({ S("="), E({ S("bin") }), V("x") })).size(), 3);
+        TS_ASSERT_EQUALS(kb.get_content(), last->get_content());
+        std::vector<AtomPtr> frogs, expected = { S("Fred") };
+        for (auto const& bindings : last->match(E({ S("isa"), V("x"), S("frog") }))) {
+            frogs.push_back(bindings.at(V("x")));
+        }
+        for (auto const& bindings : plain.match(E({ S("isa"), V("x"), S("frog") }))) {
+            expected.push_back(bindings.at(V("x")));
+        }
+        TS_ASSERT_EQUALS(to_string(frogs, " "), to_string(expected, " "));
+
+        GroundingSpace target;
+        atomese.parse("(bin)", target);
+        target.publish();
+        AtomPtr result;
+        std::vector<AtomPtr> results;
+        while (*(result = interpret_until_result(target, *last)) != *S("eos")) {
+            results.push_back(result);
+        }
+        TS_ASSERT_EQUALS(to_string(results, " "), "2 1 0");
+        TS_ASSERT_EQUALS(target.snapshot()->to_string(), "<(bin)>");
+    }
+
+    void test_interpret_space_published_after_each_step() {
+        Atomese atomese;
+        GroundingSpace kb, target;
+        atomese.parse("(= (color) red) (= (color) green)", kb);
+        for (int i = 0; i < 20; ++i) {
+            target.add_atom(E({ S("color") }));
+        }
+        std::vector<AtomPtr> const atoms = { E({ S("color") }), S("red"), S("green") };
+        auto count = [](std::vector<AtomPtr> const& content, AtomPtr const& atom) -> size_t {
+            return std::count_if(content.begin(), content.end(),
+                    [&atom](AtomPtr const& other) -> bool { return *other == *atom; });
+        };
+        std::vector<std::shared_ptr<GroundingSpace const>> versions;
+        std::vector<std::vector<AtomPtr>> contents;
+        std::vector<AtomPtr> results;
+        while (target.size() > 0) {
+            target.publish();
+            versions.push_back(target.snapshot());
+            contents.push_back(target.get_content());
+            AtomPtr result = target.interpret_step(kb);
+            if (result != Atom::INVALID) {
+                results.push_back(result);
+            }
+            std::vector<AtomPtr> const& content = target.get_content();
+            for (auto const& atom : atoms) {
+                TS_ASSERT_EQUALS(target.count(atom), count(content, atom));
+            }
+        }
+
+        TS_ASSERT_EQUALS(results.size(), 40);
+        TS_ASSERT_EQUALS(target.count(V("x")), 0);
+        for (size_t i = 0; i < versions.size(); ++i) {
+            TS_ASSERT_EQUALS(versions[i]->get_content(), contents[i]);
+            for (auto const& atom : atoms) {
+                TS_ASSERT_EQUALS(versions[i]->count(atom), count(contents[i], atom));
+            }
+        }
+    }
+
+    void test_remove_and_replace_atoms() {
+        Atomese atomese;
+        GroundingSpace kb;
+        kb.compile_rules();
+        atomese.parse("(= (color apple) red) (= (color $x) green)", kb);
+        for (int i = 0; i < 10; ++i) {
+            kb.add_atom(E({ S("sensor"), Int(i) }));
+        }
+        kb.publish();
+        std::shared_ptr<GroundingSpace const> before = kb.snapshot();
+        AnswerTable table;
+        table.add_head(S("color"));
+        auto colors = [&table](GroundingSpace const& kb) -> std::string {
+            Interpreter interpreter(kb, &table);
+            interpreter.add_atom(E({ S("color"), S("apple") }));
+            std::vector<AtomPtr> results;
+            AtomPtr result;
+            while (*(result = interpret_until_result(interpreter)) != *S("eos")) {
+                results.push_back(result);
+            }
+            return to_string(results, " ");
+        };
+        TS_ASSERT_EQUALS(colors(kb), "green red");
+
+        TS_ASSERT(kb.remove_atom(E({ S("="), E({ S("color"), V("x") }), S("green") })));
+        TS_ASSERT(!kb.remove_atom(E({ S("sensor"), Int(10) })));
+        TS_ASSERT_EQUALS(colors(kb), "red");
+        kb.publish();
+        std::shared_ptr<GroundingSpace const> removed = kb.snapshot();
+        TS_ASSERT_EQUALS(kb.remove_matching(E({ S("sensor"), V("x") })), 10);
+        TS_ASSERT(kb.replace_atom(E({ S("="), E({ S("color"), S("apple") }), S("red") }),
+                    E({ S("="), E({ S("color"), S("apple") }), S("yellow") })));
+        TS_ASSERT_EQUALS(kb.to_string(), "<(= (color apple) yellow)>");
+        TS_ASSERT_EQUALS(colors(kb), "yellow");
+
+        TS_ASSERT_EQUALS(before->size(), 12);
+        TS_ASSERT_EQUALS(before->count(E({ S("sensor"), V("x") })), 10);
+        TS_ASSERT_EQUALS(colors(*before), "green red");
+        TS_ASSERT_EQUALS(removed->size(), 11);
+        TS_ASSERT_EQUALS(removed->get_content().size(), 11);
+        TS_ASSERT_EQUALS(colors(*removed), "red");
+        kb.publish();
+        TS_ASSERT_EQUALS(kb.snapshot()->to_string(), "<(= (color apple) yellow)>");
+
+        GroundingSpace target;
+        atomese.parse("(color apple) (color pear)", target);
+        TS_ASSERT(target.remove_atom(E({ S("color"), S("pear") })));
+        TS_ASSERT(*interpret_until_result(target, kb) == *S("yellow"));
+        TS_ASSERT(*interpret_until_result(target, kb) == *S("eos"));
+    }
+
+    void test_content_is_kept_while_space_is_modified() {
+        GroundingSpace space{ S("a"), S("b"), S("c") };
+        TS_ASSERT(space.remove_atom(S("b")));
+
+        std::vector<AtomPtr> const& content = space.get_content();
+        TS_ASSERT(space.remove_atom(S("a")));
+        space.add_atom(S("d"));
+
+        TS_ASSERT_EQUALS(content, std::vector<AtomPtr>({ S("a"), S("c") }));
+        TS_ASSERT_EQUALS(space.get_content(), std::vector<AtomPtr>({ S("c"), S("d") }));
+    }
+
+    void test_interpret_parallel_using_view_while_kb_is_compacted() {
+        GroundingSpace kb;
+        add_factorial_definition(kb);
+        for (int i = 0; i < 100; ++i) {
+            kb.add_atom(E({ S("sensor"), Int(i) }));
+        }
+        std::shared_ptr<GroundingSpace const> view = kb.view();
+        GroundingSpace target;
+        for (int i = 0; i < 20; ++i) {
+            target.add_atom(E({ S("fact"), Int(6) }));
+        }
+
+        std::vector<AtomPtr> results;
+        std::thread interpreter([&target, &view, &results]() -> void {
+                    results = target.interpret_parallel(*view, 4, false);
+                });
+        for (int i = 0; i < 100; ++i) {
+            kb.remove_atom(E({ S("sensor"), Int(i) }));
+            kb.add_atom(E({ S("sensor"), Int(100 + i) }));
+        }
+        TS_ASSERT_EQUALS(kb.remove_matching(E({ S("="), V("x"), V("y") })), 3);
+        interpreter.join();
+
+        TS_ASSERT_EQUALS(results.size(), 20);
+        for (auto const& result : results) {
+            TS_ASSERT(*result == *Int(720));
+        }
+        TS_ASSERT_EQUALS(view->size(), 103);
+        TS_ASSERT_EQUALS(view->count(E({ S("sensor"), Int(0) })), 1);
+        TS_ASSERT_EQUALS(kb.size(), 100);
+        TS_ASSERT_EQUALS(kb.count(E({ S("sensor"), Int(0) })), 0);
+    }
+
+    void test_query_versions_while_writer_adds_atoms() {
+        GroundingSpace kb;
+        kb.compile_rules();
+        add_factorial_definition(kb);
+        kb.publish();
+        size_t rules = kb.size();
+        size_t const facts = 2000;
+        std::atomic<bool> done{false};
+        std::vector<std::string> errors(4);
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < errors.size(); ++i) {
+            readers.emplace_back([&kb, &done, &errors, rules, i]() -> void {
+                while (!done && errors[i].empty()) {
+                    std::shared_ptr<GroundingSpace const> version = kb.snapshot();
+                    AtomPtr pattern = E({ S("sensor"), V("t"), V("v") });
+                    size_t count = version->count(pattern);
+                    if (count != version->size() - rules) {
+                        errors[i] = "count " + std::to_string(count) +
+                            " of " + std::to_string(version->size());
+                    }
+                    Interpreter interpreter(*version);
+                    interpreter.add_atom(E({ S("fact"), Int(4) }));
+                    AtomPtr result = interpret_until_result(interpreter);
+                    if (*result != *Int(24)) {
+                        errors[i] = "fact 4: " + result->to_string();
+                    }
+                    if (version->count(pattern) != count) {
+                        errors[i] = "version is changed";
+                    }
+                }
+            });
+        }
+        for (size_t i = 0; i < facts; ++i) {
+            kb.add_atom(E({ S("sensor"), Int(i), Int(i % 10) }));
+            if (i % 5 == 4) {
+                kb.remove_atom(E({ S("sensor"), Int(i - 1), Int((i - 1) % 10) }));
+            }
+            if (i % 3 == 0) {
+                kb.publish();
+            }
+        }
+        kb.publish();
+        std::shared_ptr<GroundingSpace const> last = kb.snapshot();
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        for (auto const& error : errors) {
+            TS_ASSERT_EQUALS(error, "");
+        }
+        TS_ASSERT_EQUALS(last->count(E({ S("sensor"), V("t"), Int(3) })), 0);
+        TS_ASSERT_EQUALS(last->count(E({ S("sensor"), V("t"), Int(5) })), facts / 10);
+    }
+
+    void test_disabled_log_messages_are_not_formatted() {
+        Logger::Level level = Logger::getLevel();
+        Logger::setLevel(Logger::ERROR);
+        auto counting = std::make_shared<CountingAtom>();
+        GroundingSpace kb, target;
+        kb.add_atom(E({ S("="), E({ S("f"), counting }), S("g") }));
+        target.add_atom(E({ S("f"), counting }));
+
+        TS_ASSERT_EQUALS(kb.match(E({ S("="), V("x"), V("y") })).size(), 1);
+        AtomPtr result = interpret_until_result(target, kb);
+        Logger::setLevel(level);
+
+        TS_ASSERT(*result == *S("g"));
+        TS_ASSERT_EQUALS(counting->calls, 0);
+    }
+
+    void test_trace_interpreter_steps() {
+        GroundingSpace kb, target;
+        add_factorial_definition(kb);
+        target.add_atom(E({ S("fact"), Int(3) }));
+        Tracer::clear();
+        Tracer::setEnabled(true);
+        AtomPtr result = interpret_until_result(target, kb);
+        Tracer::setEnabled(false);
+        kb.count(E({ S("fact"), V("x") }));
+
+        std::ostringstream trace;
+        Tracer::writeChromeTrace(trace);
+        auto count = [&trace](std::string const& event) -> size_t {
+            std::string str = trace.str();
+            size_t count = 0;
+            for (size_t i = str.find(event); i != std::string::npos; i = str.find(event, i + 1)) {
+                ++count;
+            }
+            return count;
+        };
+        TS_ASSERT(*result == *Int(6));
+        TS_ASSERT_EQUALS(trace.str().substr(0, 16), "{\"traceEvents\":[");
+        for (auto const& name : { "interpret_step", "unify", "execute", "apply_rule" }) {
+            std::string begin = std::string("\"name\":\"") + name + "\",\"ph\":\"B\"";
+            std::string end = std::string("\"name\":\"") + name + "\",\"ph\":\"E\"";
+            TS_ASSERT_LESS_THAN(0, count(begin));
+            TS_ASSERT_EQUALS(count(begin), count(end));
+        }
+        TS_ASSERT_EQUALS(count("\"match\""), 0);
+
+        Tracer::clear();
+        trace.str("");
+        Tracer::writeChromeTrace(trace);
+        TS_ASSERT_EQUALS(trace.str(), "{\"traceEvents\":[\n]}\n");
+    }
+
+    void test_engine_statistics() {
+        GroundingSpace kb, target;
+        add_factorial_definition(kb);
+        for (int i = 0; i < 10; ++i) {
+            kb.add_atom(E({ S("isa"), S("obj" + std::to_string(i)), S(i % 2 ? "lamp" : "frog") }));
+        }
+        target.add_atom(E({ S("fact"), Int(3) }));
+        Stats::setAtomCounting(true);
+        Stats::reset();
+        Stats::Snapshot before = Stats::getTotals();
+        AtomPtr result = interpret_until_result(target, kb);
+        size_t frogs = kb.snapshot()->count(E({ S("isa"), V("x"), S("frog") }));
+        kb.publish();
+        std::vector<Bindings> lamps = kb.snapshot()->match(E({ S("isa"), V("x"), S("lamp") }));
+        Stats::Snapshot stats = Stats::getSnapshot();
+        SpaceStats space = kb.get_stats();
+        Stats::setAtomCounting(false);
+
+        TS_ASSERT(*result == *Int(6));
+        TS_ASSERT_EQUALS(frogs, 0);
+        TS_ASSERT_EQUALS(lamps.size(), 5);
+        TS_ASSERT_LESS_THAN(0, stats.counters[Stats::INTERPRETER_STEPS]);
+        TS_ASSERT_LESS_THAN(0, stats.counters[Stats::GROUNDED_CALLS]);
+        TS_ASSERT_LESS_THAN(0, stats.counters[Stats::ATOMS_ALLOCATED]);
+        TS_ASSERT_LESS_THAN_EQUALS(stats.counters[Stats::CANDIDATES_MATCHED],
+                stats.counters[Stats::CANDIDATES_SCANNED]);
+        TS_ASSERT_LESS_THAN_EQUALS(5, stats.counters[Stats::BINDINGS_CREATED]);
+        size_t interpretations = 0;
+        size_t matches = 0;
+        for (size_t i = 0; i < Stats::BUCKETS; ++i) {
+            interpretations += stats.buckets[Stats::INTERPRET_LATENCY][i];
+            matches += stats.buckets[Stats::MATCH_LATENCY][i];
+        }
+        TS_ASSERT_EQUALS(interpretations, 1);
+        TS_ASSERT_EQUALS(matches, 2);
+        // queries of the published version are counted by the space
+        TS_ASSERT_LESS_THAN(2, space.queries);
+        TS_ASSERT_LESS_THAN_EQUALS(10, space.candidates_scanned);
+        TS_ASSERT_LESS_THAN_EQUALS(5, space.candidates_matched);
+        TS_ASSERT_EQUALS(space.size, kb.size());
+
+        std::ostringstream prometheus;
+        Stats::writePrometheus(prometheus);
+        write_prometheus(prometheus, { { "kb", space }, { "say \"hi\"\n", space } });
+        TS_ASSERT_DIFFERS(prometheus.str().find("# TYPE hyperon_interpreter_steps_total counter\n"),
+                std::string::npos);
+        TS_ASSERT_DIFFERS(prometheus.str().find("# TYPE hyperon_interpret_latency_seconds histogram\n"),
+                std::string::npos);
+        TS_ASSERT_DIFFERS(prometheus.str().find("# TYPE hyperon_space_queries_total counter\n"
+                    "hyperon_space_queries_total{space=\"kb\"} " + std::to_string(space.queries) +
+                    "\nhyperon_space_queries_total{space=\"say \\\"hi\\\"\\n\"} "),
+                std::string::npos);
+        TS_ASSERT_DIFFERS(prometheus.str().find("# TYPE hyperon_space_size gauge\n"
+                    "hyperon_space_size{space=\"kb\"} " + std::to_string(kb.size()) + "\n"),
+                std::string::npos);
+
+        Stats::reset();
+        TS_ASSERT_EQUALS(Stats::getSnapshot().counters[Stats::INTERPRETER_STEPS], 0);
+        // totals exported to Prometheus are not reset
+        Stats::Snapshot totals = Stats::getTotals();
+        for (size_t i = 0; i < Stats::COUNTERS; ++i) {
+            TS_ASSERT_LESS_THAN_EQUALS(before.counters[i] + stats.counters[i], totals.counters[i]);
+        }
+        AtomPtr atom = S("not-counted");
+        TS_ASSERT_EQUALS(Stats::getSnapshot().counters[Stats::ATOMS_ALLOCATED], 0);
+    }
+
+    void test_profile_rules_and_grounded_atoms() {
+        GroundingSpace kb, target;
+        add_factorial_definition(kb);
+        target.add_atom(E({ S("fact"), Int(3) }));
+        Profiler::clear();
+        Profiler::setEnabled(true);
+        AtomPtr result = interpret_until_result(target, kb);
+        Profiler::setEnabled(false);
+
+        std::ostringstream report;
+        Profiler::writeReport(report);
+        auto line = [&report](std::string const& name) -> std::string {
+            std::istringstream lines(report.str());
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (line.size() >= name.size() &&
+                        line.compare(line.size() - name.size(), name.size(), name) == 0) {
+                    return line;
+                }
+            }
+            return "";
+        };
+        auto counts = [&line](std::string const& name) -> std::vector<double> {
+            std::istringstream columns(line(name));
+            std::vector<double> counts(4);
+            for (auto& count : counts) {
+                columns >> count;
+            }
+            return counts;
+        };
+        TS_ASSERT(*result == *Int(6));
+        TS_ASSERT_DIFFERS(report.str().find("attempts"), std::string::npos);
+        std::vector<double> fact = counts("#2 " + kb.get_atom(2)->to_string());
+        TS_ASSERT_EQUALS(fact[1], 4);
+        TS_ASSERT_EQUALS(fact[2], 4);
+        TS_ASSERT_EQUALS(fact[3], 4);
+        // condition is not evaluated before unification, so both rules of
+        // if are unified on each call
+        std::vector<double> if_false = counts("#1 " + kb.get_atom(1)->to_string());
+        TS_ASSERT_EQUALS(if_false[1], 4);
+        TS_ASSERT_EQUALS(if_false[2], 4);
+        std::vector<double> mul = counts("  " + MUL->to_string());
+        TS_ASSERT_EQUALS(mul[1], 3);
+        TS_ASSERT_EQUALS(mul[3], 3);
+
+        Profiler::clear();
+        report.str("");
+        Profiler::writeReport(report);
+        TS_ASSERT_EQUALS(line("#2 " + kb.get_atom(2)->to_string()), "");
+    }
+
     void test_not_reduct_ifmatch_arguments_before_matching() {
         Logger::setLevel(Logger::DEBUG);
         Atomese atomese;
@@ -135,4 +1027,32 @@ public:
 
         TS_ASSERT(*Int(3) == *result);
     }
+
+    void test_parse_by_atomese_shared_by_threads() {
+        Atomese const atomese;
+        std::string program = "(= (fact $n) (if (== 0 $n) 1 (* (fact (- $n 1)) $n)))"
+            " (fact 5.0) (len (:: 1 (:: 2 nil)))";
+        GroundingSpace expected;
+        atomese.parse(program, expected);
+
+        std::atomic<int> mismatches{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&]() -> void {
+                for (int j = 0; j < 100; ++j) {
+                    GroundingSpace kb;
+                    atomese.parse(program, kb);
+                    if (!(kb == expected)) {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        TS_ASSERT_EQUALS(expected.get_content().size(), 3);
+        TS_ASSERT_EQUALS(mismatches, 0);
+    }
 };
@@ -1,6 +1,9 @@
 #include <cxxtest/TestSuite.h>
 
+#include <random>
+
 #include <hyperon/hyperon.h>
+#include <hyperon/TokenAutomaton.h>
 
 class FloatAtom : public ValueAtom<float> {
 public:
@@ -9,6 +12,36 @@ public:
     std::string to_string() const override { return std::to_string(get()); }
 };
 
+// Token atom keeps the index of the token which matched it
+class TokenAtom : public ValueAtom<std::string> {
+public:
+    TokenAtom(size_t index, std::string token)
+        : ValueAtom(std::to_string(index) + ":" + token) {}
+    virtual ~TokenAtom() {}
+    std::string to_string() const override { return get(); }
+};
+
+template<typename Regex>
+static void register_tokens(TextSpace& text, std::vector<std::string> const& regexes) {
+    for (size_t i = 0; i < regexes.size(); ++i) {
+        text.register_token(Regex(regexes[i]),
+                [i] (std::string token) -> GroundedAtomPtr {
+                    return std::make_shared<TokenAtom>(i, token);
+                });
+    }
+}
+
+static GroundingSpace parse_string(TextSpace& text, std::string const& str) {
+    text.add_string(str);
+    GroundingSpace space;
+    space.add_from_space(text);
+    return space;
+}
+
+static AtomPtr T(size_t index, std::string token) {
+    return std::make_shared<TokenAtom>(index, token);
+}
+
 class TextSpaceTest : public CxxTest::TestSuite {
 public:
 
@@ -63,4 +96,123 @@ public:
         expected.add_atom(E({ S("+"), std::make_shared<FloatAtom>(1.0), std::make_shared<FloatAtom>(2.0) }));
         TS_ASSERT_EQUALS(space, expected);
     }
+
+    void test_parse_tokens_in_registration_order() {
+        TextSpace text;
+        register_tokens<std::string>(text, { "[a-z]+", "match", "\\d+", "\\d+\\.\\d+" });
+
+        GroundingSpace space = parse_string(text, "(match 1.5)");
+
+        GroundingSpace expected;
+        expected.add_atom(E({ T(0, "match"), T(2, "1"), S(".5") }));
+        TS_ASSERT_EQUALS(space, expected);
+    }
+
+    void test_parse_regex_and_string_tokens_in_registration_order() {
+        TextSpace text;
+        text.register_token("\\d+", [] (std::string token) -> GroundedAtomPtr {
+                    return std::make_shared<TokenAtom>(0, token);
+                });
+        text.register_token(std::regex("\\d+\\.?"), [] (std::string token) -> GroundedAtomPtr {
+                    return std::make_shared<TokenAtom>(1, token);
+                });
+        text.register_token(std::regex("[a-z]+"), [] (std::string token) -> GroundedAtomPtr {
+                    return std::make_shared<TokenAtom>(2, token);
+                });
+        text.register_token("[a-z]+\\d", [] (std::string token) -> GroundedAtomPtr {
+                    return std::make_shared<TokenAtom>(3, token);
+                });
+
+        GroundingSpace space = parse_string(text, "(12. ab1)");
+
+        GroundingSpace expected;
+        expected.add_atom(E({ T(0, "12"), S("."), T(2, "ab"), T(0, "1") }));
+        TS_ASSERT_EQUALS(space, expected);
+    }
+
+    void test_parse_token_with_unsupported_regex() {
+        TextSpace text;
+        register_tokens<std::string>(text, { "([a-z])\\1", "[a-z]+" });
+
+        GroundingSpace space = parse_string(text, "(aab ba)");
+
+        GroundingSpace expected;
+        expected.add_atom(E({ T(0, "aa"), T(1, "b"), T(1, "ba") }));
+        TS_ASSERT_EQUALS(space, expected);
+    }
+
+    void test_parse_invalid_regex_token() {
+        TextSpace text;
+        TS_ASSERT_THROWS(text.register_token("[a-", [] (std::string token) -> AtomPtr {
+                    return S(token);
+                }), std::regex_error const&);
+    }
+
+    void test_compiled_tokens_are_equivalent_to_regex_tokens() {
+        std::vector<std::string> regexes{ "(a|ab)c?", "ba*(ab)?",
+            "\\d+|\\d+\\.\\d+", "\\+", "-", "\\*", "\\/", "==", "<", ">", "or",
+            "and", "not", "\\d+(\\.\\d+)", "\\d+", "'[^']*'", "True|False", "match",
+            "call:[^\\s)]+", ",", "let", "\\d+(\\.\\d+)?", "\"[^\"]*\"", "\\+\\+",
+            "[a-z]{2,3}", "x*y", "[^\\W\\d]\\w?" };
+        std::string alphabet = "+-*/=<>'\" .,:Tt1rue0Fadnoxylcmab1.ab\t";
+        std::mt19937 random(1);
+        for (int i = 0; i < 200; ++i) {
+            std::string str;
+            for (int length = random() % 40; length > 0; --length) {
+                str += alphabet[random() % alphabet.size()];
+            }
+            TextSpace compiled;
+            register_tokens<std::string>(compiled, regexes);
+            TextSpace interpreted;
+            register_tokens<std::regex>(interpreted, regexes);
+            TS_ASSERT_EQUALS(parse_string(compiled, str), parse_string(interpreted, str));
+        }
+    }
+
+    // Regexes which match the empty string cannot be tokens, they are
+    // compared with std::regex by the automaton directly
+    void test_automaton_matches_as_regex() {
+        std::vector<std::string> regexes{ "a*(ab)?", "(a|ab)c?", "(|a)",
+            "a?b*", "(ab|a)*", "\\d+(\\.\\d+)?", "(a|b)*c?", "a{0,2}(ab)?" };
+        std::string alphabet = "abc.1";
+        std::mt19937 random(1);
+        for (std::string const& regex : regexes) {
+            TokenAutomaton automaton;
+            if (!automaton.add(0, regex)) {
+                continue;
+            }
+            for (int i = 0; i < 100; ++i) {
+                std::string str;
+                for (int length = random() % 8; length > 0; --length) {
+                    str += alphabet[random() % alphabet.size()];
+                }
+                char const* begin = str.c_str();
+                char const* end = begin + str.size();
+                std::cmatch match;
+                bool matched = std::regex_search(begin, end, match, std::regex(regex),
+                        std::regex_constants::match_continuous);
+                TokenAutomaton::Match found = automaton.match(begin, end);
+                TS_ASSERT_EQUALS(found.priority == 0, matched);
+                if (matched) {
+                    TS_ASSERT_EQUALS(found.length, match.length());
+                }
+            }
+        }
+    }
+
+    void test_parse_string_view() {
+        TextSpace text;
+        register_tokens<std::string>(text, { "\\d+" });
+        std::string program = "(a 12) 345";
+        std::vector<AtomPtr> atoms;
+
+        text.parse(std::string_view(program).substr(0, 8),
+                [&atoms] (AtomPtr atom) -> void { atoms.push_back(atom); });
+
+        TS_ASSERT_EQUALS(atoms.size(), 2);
+        TS_ASSERT(*E({ S("a"), T(0, "12") }) == *atoms[0]);
+        TS_ASSERT(*T(0, "3") == *atoms[1]);
+        TS_ASSERT_THROWS(text.parse(std::string_view(program).substr(0, 5),
+                    [] (AtomPtr) -> void {}), std::runtime_error const&);
+    }
 };
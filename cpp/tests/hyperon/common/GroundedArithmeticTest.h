@@ -17,6 +17,15 @@ public:
         TS_ASSERT(*result == *Int(3));
     }
 
+    void test_execute_using_grounding_space() {
+        GroundingSpace args({ MUL, Int(2), Int(3) });
+        GroundingSpace result;
+
+        MUL->execute(args, result);
+
+        TS_ASSERT(result == GroundingSpace({ Int(6) }));
+    }
+
     void test_plus_float_in_text_space() {
         TextSpace text_kb;
         text_kb.register_token(std::regex("\\d+(\\.\\d+)?"),
@@ -7,7 +7,11 @@ from hyperonpy import (
         GroundingSpace,
         TextSpace,
         Logger,
-        IFMATCH)
+        Tracer,
+        Stats,
+        Profiler,
+        IFMATCH,
+        set_hash_consing)
 
 def E(*args):
     return _E(list(args))
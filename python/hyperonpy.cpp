@@ -1,27 +1,35 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <sstream>
 
 #include <hyperon/hyperon.h>
 
 namespace py = pybind11;
 
+// Virtual methods overridden in Python are called by interpreter threads
+// which don't hold GIL (see interpret_parallel), so each of them acquires
+// it before touching Python objects.
 class PySpaceAPI : public SpaceAPI {
 public:
     using SpaceAPI::SpaceAPI;
 
     void add_to(SpaceAPI& graph) const override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE(void, SpaceAPI, add_to, graph);
     }
 
     void add_from_space(const SpaceAPI& graph) override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE(void, SpaceAPI, add_from_space, graph);
     }
 
     void add_native(const SpaceAPI* pGraph) override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE(void, SpaceAPI, add_native, pGraph);
     }
 
     std::string get_type() const override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE(std::string, SpaceAPI, get_type,)
     }
     
@@ -31,12 +39,16 @@ public:
 // Python reference until shared pointer is released. This is required when
 // Python object is returned by virtual method defined in C++ class and
 // overriden in Python class. Without inc_ref() Python interpreter releases
-// reference just after Python object is returned to caller.
+// reference just after Python object is returned to caller. Shared pointer
+// can be released by interpreter thread so deleter acquires GIL.
 template<typename T>
 std::shared_ptr<T> py_shared_ptr(py::handle pyobj) {
     pyobj.inc_ref();
     return std::shared_ptr<T>(pyobj.cast<T*>(),
-            [](T* p) -> void { py::cast(p).dec_ref(); });
+            [](T* p) -> void {
+                py::gil_scoped_acquire gil;
+                py::cast(p).dec_ref();
+            });
 }
 
 std::vector<AtomPtr> py_list(py::list atoms) {
@@ -47,11 +59,20 @@ std::vector<AtomPtr> py_list(py::list atoms) {
     return content;
 }
 
+py::dict py_bindings(Bindings const& bindings) {
+    py::dict result;
+    for (auto const& pair : bindings) {
+        result[py::str(pair.first->get_name())] = pair.second;
+    }
+    return result;
+}
+
 class PyAtom : public Atom {
 public:
     using Atom::Atom;
 
     bool operator==(Atom const& other) const override {
+        py::gil_scoped_acquire gil;
         // workaround for a pybind11 issue https://github.com/pybind/pybind11/issues/2033
         // see https://stackoverflow.com/a/59331026/14016260 for explanation
         py::object dummy = py::cast(&other);
@@ -59,6 +80,7 @@ public:
     }
 
     std::string to_string() const override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE_NAME(std::string, Atom, "__repr__", to_string,);
     }
 };
@@ -68,6 +90,7 @@ public:
     using GroundedAtom::GroundedAtom;
 
     void execute(GroundingSpace const& args, GroundingSpace& result) const override {
+        py::gil_scoped_acquire gil;
         // workaround for a pybind11 issue https://github.com/pybind/pybind11/issues/2033
         // see https://stackoverflow.com/a/59331026/14016260 for explanation
         py::object dummy0 = py::cast(&args);
@@ -76,6 +99,7 @@ public:
     }
 
     bool operator==(Atom const& other) const override {
+        py::gil_scoped_acquire gil;
         // workaround for a pybind11 issue https://github.com/pybind/pybind11/issues/2033
         // see https://stackoverflow.com/a/59331026/14016260 for explanation
         py::object dummy = py::cast(&other);
@@ -83,6 +107,7 @@ public:
     }
 
     std::string to_string() const override {
+        py::gil_scoped_acquire gil;
         PYBIND11_OVERLOAD_PURE_NAME(std::string, GroundedAtom, "__repr__", to_string,);
     }
 };
@@ -97,6 +122,7 @@ class PyAtomConstr {
 public:
     PyAtomConstr(py::object lambda) : lambda(std::make_shared<PyHandleHolder>(lambda)) { }
     AtomPtr operator()(std::string arg) {
+        py::gil_scoped_acquire gil;
         py::object atom = lambda->obj(arg);
         return py_shared_ptr<Atom>(atom);
     }
@@ -126,15 +152,21 @@ PYBIND11_MODULE(hyperonpy, m) {
         .value("VARIABLE", Atom::Type::VARIABLE)
         .export_values();
 
+    // SymbolAtom constructor shares symbol table with S() and returns the
+    // same interned atom for the same symbol
     py::class_<SymbolAtom, std::shared_ptr<SymbolAtom>, Atom>(m, "SymbolAtom")
-        .def(py::init<std::string>())
-        .def("get_symbol", &SymbolAtom::get_symbol);
+        .def(py::init(&S))
+        .def("get_symbol", &SymbolAtom::get_symbol)
+        .def("get_id", &SymbolAtom::get_id)
+        .def("__hash__", &SymbolAtom::get_id);
 
     m.def("S", &S); 
 
     py::class_<VariableAtom, std::shared_ptr<VariableAtom>, Atom>(m, "VariableAtom")
         .def(py::init<std::string>())
-        .def("get_name", &VariableAtom::get_name);
+        .def("get_name", &VariableAtom::get_name)
+        .def("get_id", &VariableAtom::get_id)
+        .def("__hash__", &VariableAtom::get_id);
 
     m.def("V", &V); 
 
@@ -144,16 +176,36 @@ PYBIND11_MODULE(hyperonpy, m) {
     // container interface instead of std::vector and adapt Python list to it.
     py::class_<ExprAtom, std::shared_ptr<ExprAtom>, Atom>(m, "ExprAtom")
         .def(py::init<std::vector<AtomPtr>>())
-        .def("get_children", &ExprAtom::get_children);
-
-    m.def("E", [](py::list atoms) -> AtomPtr { return E(py_list(atoms)); });
+        .def("get_children", &ExprAtom::get_children)
+        .def("is_frozen", &ExprAtom::is_frozen);
+
+    // Bindings which may lock the engine's tables release GIL: a thread
+    // holding a table lock can call Python atom and wait for GIL
+    m.def("E", [](py::list atoms) -> AtomPtr {
+                std::vector<AtomPtr> children = py_list(atoms);
+                py::gil_scoped_release release;
+                return E(children);
+            });
+    m.def("set_hash_consing", [](bool enabled) -> void {
+                ExprTable::instance().set_enabled(enabled);
+            });
 
     py::class_<GroundedAtom, PyGroundedAtom, std::shared_ptr<GroundedAtom>, Atom>(m, "GroundedAtom")
         .def(py::init<>())
-        .def("execute", &GroundedAtom::execute)
+        .def("execute", (void (GroundedAtom::*)(GroundingSpace const&, GroundingSpace&) const) &GroundedAtom::execute)
         .def("__eq__", &GroundedAtom::operator==)
         .def("__repr__", &GroundedAtom::to_string);
 
+    py::class_<MatchCursor>(m, "MatchCursor")
+        .def("__iter__", [](MatchCursor& self) -> MatchCursor& { return self; })
+        .def("__next__", [](MatchCursor& self) -> py::dict {
+                    Bindings bindings;
+                    if (!self.next(bindings)) {
+                        throw py::stop_iteration();
+                    }
+                    return py_bindings(bindings);
+                });
+
     py::class_<GroundingSpace, SpaceAPI>(m, "GroundingSpace")
         .def(py::init<>())
         .def(py::init([](py::list atoms) -> GroundingSpace* {
@@ -163,9 +215,65 @@ PYBIND11_MODULE(hyperonpy, m) {
         .def("add_atom", [](GroundingSpace* self, py::object atom) -> void {
                     self->add_atom(py_shared_ptr<Atom>(atom));
                 })
+        .def("remove_atom", [](GroundingSpace* self, py::object atom) -> bool {
+                    return self->remove_atom(py_shared_ptr<Atom>(atom));
+                })
+        .def("replace_atom", [](GroundingSpace* self, py::object atom, py::object replacement) -> bool {
+                    return self->replace_atom(py_shared_ptr<Atom>(atom),
+                            py_shared_ptr<Atom>(replacement));
+                })
+        .def("remove_matching", [](GroundingSpace* self, py::object pattern) -> size_t {
+                    return self->remove_matching(py_shared_ptr<Atom>(pattern));
+                })
+        .def("compile_rules", &GroundingSpace::compile_rules)
         .def("interpret_step", &GroundingSpace::interpret_step)
-        .def("match", (void (GroundingSpace::*)(SpaceAPI const&, SpaceAPI const&, GroundingSpace&) const) &GroundingSpace::match)
+        // Knowledge base can be changed by other Python threads while
+        // interpretation runs without GIL, so its view is interpreted
+        .def("interpret_parallel", [](GroundingSpace* self, SpaceAPI& kb,
+                        size_t threads, bool deterministic) -> std::vector<AtomPtr> {
+                    std::shared_ptr<GroundingSpace const> view;
+                    if (kb.get_type() == GroundingSpace::TYPE && &kb != self) {
+                        view = static_cast<GroundingSpace&>(kb).view();
+                    }
+                    py::gil_scoped_release release;
+                    return self->interpret_parallel(view ? *view : kb, threads, deterministic);
+                },
+                py::arg("kb"), py::arg("threads") = 0, py::arg("deterministic") = true)
+        .def("match", (void (GroundingSpace::*)(SpaceAPI const&, SpaceAPI const&, GroundingSpace&) const) &GroundingSpace::match,
+                py::call_guard<py::gil_scoped_release>())
+        // Returns generator of {variable name: value} dicts, space can be
+        // changed while generator is used, atoms added after the call are
+        // not visited
+        .def("match_iter", [](GroundingSpace const* self, py::object pattern) -> MatchCursor* {
+                    return new MatchCursor(*self, py_shared_ptr<Atom>(pattern));
+                })
+        .def("match_limit", [](GroundingSpace const* self, py::object pattern, size_t limit) -> py::list {
+                    py::list result;
+                    for (auto const& bindings : self->match(py_shared_ptr<Atom>(pattern), limit)) {
+                        result.append(py_bindings(bindings));
+                    }
+                    return result;
+                })
+        .def("exists", [](GroundingSpace const* self, py::object pattern) -> bool {
+                    AtomPtr atom = py_shared_ptr<Atom>(pattern);
+                    py::gil_scoped_release release;
+                    return self->exists(atom);
+                })
+        .def("count", [](GroundingSpace const* self, py::object pattern) -> size_t {
+                    AtomPtr atom = py_shared_ptr<Atom>(pattern);
+                    py::gil_scoped_release release;
+                    return self->count(atom);
+                })
         .def("get_content", &GroundingSpace::get_content)
+        .def("get_stats", [](GroundingSpace const* self) -> py::dict {
+                    SpaceStats stats = self->get_stats();
+                    py::dict result;
+                    result["queries"] = stats.queries;
+                    result["candidates_scanned"] = stats.candidates_scanned;
+                    result["candidates_matched"] = stats.candidates_matched;
+                    result["size"] = stats.size;
+                    return result;
+                })
         .def("__eq__", &GroundingSpace::operator==)
         .def("__repr__", &GroundingSpace::to_string);
     
@@ -175,7 +283,11 @@ PYBIND11_MODULE(hyperonpy, m) {
         .def("add_string", &TextSpace::add_string)
         .def("register_token",
                 [](TextSpace* self, std::string regex, py::object constr) -> void {
-                    self->register_token(std::regex(regex), PyAtomConstr(constr));
+                    self->register_token(regex, PyAtomConstr(constr));
+                })
+        .def("parse",
+                [](TextSpace const* self, std::string_view program, GroundingSpace& space) -> void {
+                    self->parse(program, [&space](AtomPtr atom) -> void { space.add_atom(atom); });
                 });
 
     py::class_<Logger> logger(m, "Logger");
@@ -188,6 +300,56 @@ PYBIND11_MODULE(hyperonpy, m) {
         .value("TRACE", Logger::Level::TRACE)
         .export_values();
 
+    py::class_<Tracer>(m, "Tracer")
+        .def_static("setEnabled", &Tracer::setEnabled)
+        .def_static("isEnabled", &Tracer::isEnabled)
+        .def_static("chromeTrace", []() -> std::string {
+                    std::ostringstream out;
+                    Tracer::writeChromeTrace(out);
+                    return out.str();
+                })
+        .def_static("clear", &Tracer::clear);
+
+    // Snapshot is {"counters": {name: value}, "histograms": {name:
+    // {"buckets": [count...], "sum": seconds}}}
+    py::class_<Stats>(m, "Stats")
+        .def_static("snapshot", []() -> py::dict {
+                    Stats::Snapshot snapshot = Stats::getSnapshot();
+                    py::dict counters;
+                    for (size_t i = 0; i < Stats::COUNTERS; ++i) {
+                        counters[Stats::getName(static_cast<Stats::Counter>(i))] = snapshot.counters[i];
+                    }
+                    py::dict histograms;
+                    for (size_t i = 0; i < Stats::HISTOGRAMS; ++i) {
+                        py::dict histogram;
+                        histogram["buckets"] = std::vector<uint64_t>(snapshot.buckets[i],
+                                snapshot.buckets[i] + Stats::BUCKETS);
+                        histogram["sum"] = snapshot.nanoseconds[i] * 1e-9;
+                        histograms[Stats::getName(static_cast<Stats::Histogram>(i))] = histogram;
+                    }
+                    py::dict result;
+                    result["counters"] = counters;
+                    result["histograms"] = histograms;
+                    return result;
+                })
+        .def_static("prometheus", []() -> std::string {
+                    std::ostringstream out;
+                    Stats::writePrometheus(out);
+                    return out.str();
+                })
+        .def_static("reset", &Stats::reset)
+        .def_static("set_atom_counting", &Stats::setAtomCounting);
+
+    py::class_<Profiler>(m, "Profiler")
+        .def_static("setEnabled", &Profiler::setEnabled)
+        .def_static("isEnabled", &Profiler::isEnabled)
+        .def_static("report", []() -> std::string {
+                    std::ostringstream out;
+                    Profiler::writeReport(out);
+                    return out.str();
+                })
+        .def_static("clear", &Profiler::clear);
+
     m.attr("IFMATCH") = IFMATCH;
 }
 
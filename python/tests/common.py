@@ -174,8 +174,12 @@ class Atomese:
 
     def __init__(self):
         self.tokens = {}
+        self.parser = None
 
     def _parser(self):
+        # parser is built once and rebuilt when tokens are added
+        if self.parser is not None:
+            return self.parser
         parser = TextSpace()
         parser.register_token("\+", lambda token: AddAtom())
         parser.register_token("-", lambda token: SubAtom())
@@ -197,18 +201,18 @@ class Atomese:
         parser.register_token("let", lambda token: IFMATCH)
         for regexp in self.tokens.keys():
             parser.register_token(regexp, self.tokens[regexp])
+        self.parser = parser
         return parser
 
     def parse(self, program, kb=None):
         if not kb:
             kb = GroundingSpace()
-        text = self._parser()
-        text.add_string(program)
-        kb.add_from_space(text)
+        self._parser().parse(program, kb)
         return kb
 
     def add_token(self, regexp, constr):
         self.tokens[regexp] = constr
+        self.parser = None
 
     def add_atom(self, name, symbol):
         self.add_token(name, lambda _: symbol)
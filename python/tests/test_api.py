@@ -96,6 +96,19 @@ class ApiTest(unittest.TestCase):
         expected.add_atom(E(S("+"), S("1"), S("2")))
         self.assertEqual(kb, expected)
 
+    def test_textspace_parse_reuses_tokens(self):
+        text = TextSpace()
+        text.register_token("\\d+", lambda token: ValueAtom(int(token)))
+        kb = GroundingSpace()
+
+        text.parse("(+ 1 2)", kb)
+        text.parse("(* 3 4)", kb)
+
+        expected = GroundingSpace()
+        expected.add_atom(E(S("+"), ValueAtom(1), ValueAtom(2)))
+        expected.add_atom(E(S("*"), ValueAtom(3), ValueAtom(4)))
+        self.assertEqual(kb, expected)
+
 class X2Atom(GroundedAtom):
 
     def __init__(self):
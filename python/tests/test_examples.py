@@ -137,6 +137,31 @@ class ExamplesTest(unittest.TestCase):
         output = interpret_and_print_results(target, kb)
         self.assertEqual(output, '(stop kettle)\n(stop humidifier)\n(start ventilation)\n')
 
+        target = atomese.parse('(is (air wet))')
+        output = target.interpret_parallel(kb, threads=4)
+        self.assertEqual(list(map(str, output)),
+                ['(stop kettle)', '(stop humidifier)', '(start ventilation)'])
+
+    def test_interpret_parallel_with_python_atoms(self):
+        atomese = Atomese()
+
+        kb = atomese.parse('''
+           (= (if True $then) $then)
+           (= (bin) 0)
+           (= (bin) 1)
+           (= (bits) (+ (* 4 (bin)) (+ (* 2 (bin)) (bin))))
+           (= (max) (if (and (< (bits) 8) (== (bits) 7)) max))
+        ''')
+
+        for i in range(50):
+            target = atomese.parse('(bits)')
+            output = target.interpret_parallel(kb, threads=8, deterministic=False)
+            self.assertEqual(sorted(atom.value for atom in output), list(range(8)))
+
+            target = atomese.parse('(max)')
+            output = target.interpret_parallel(kb, threads=8, deterministic=False)
+            self.assertEqual(list(map(str, output)).count('max'), 8)
+
     # FIXME: segfault after this test is executed
     def _test_subset_sum_problem(self):
         atomese = Atomese()
@@ -46,6 +46,73 @@ class MatchingTest(unittest.TestCase):
 
         self.assertEqual(actual, E(S('isa'), S('Fred'), S('green')))
 
+    def test_match_iter_limit_exists_count(self):
+        kb = self.atomese.parse('''
+            (isa kitchen-lamp lamp)
+            (isa Fred frog)
+            (isa bedroom-lamp lamp)
+        ''')
+        pattern = E(S('isa'), V('x'), S('lamp'))
+
+        results = kb.match_iter(pattern)
+
+        self.assertEqual(next(results), {'x': S('kitchen-lamp')})
+        self.assertEqual(list(results), [{'x': S('bedroom-lamp')}])
+        self.assertEqual(kb.match_limit(pattern, 1), [{'x': S('kitchen-lamp')}])
+        self.assertEqual(kb.count(pattern), 2)
+        self.assertTrue(kb.exists(E(S('isa'), V('x'), S('frog'))))
+        self.assertFalse(kb.exists(E(S('isa'), V('x'), S('toad'))))
+
+    def test_match_iter_while_space_is_changed(self):
+        kb = self.atomese.parse(' '.join('(isa lamp{} lamp)'.format(i) for i in range(10)))
+        pattern = E(S('isa'), V('x'), S('lamp'))
+
+        results = kb.match_iter(pattern)
+        self.assertEqual(next(results), {'x': S('lamp0')})
+        self.assertEqual(kb.remove_matching(E(S('isa'), S('lamp1'), V('x'))), 1)
+        for i in range(2, 7):
+            kb.remove_atom(E(S('isa'), S('lamp{}'.format(i)), S('lamp')))
+        kb.add_atom(E(S('isa'), S('hall-lamp'), S('lamp')))
+
+        self.assertEqual(list(results), [{'x': S('lamp7')}, {'x': S('lamp8')},
+            {'x': S('lamp9')}])
+        self.assertEqual(kb.count(pattern), 5)
+
+    def test_remove_and_replace_atoms(self):
+        kb = self.atomese.parse('''
+            (isa kitchen-lamp lamp)
+            (state kitchen-lamp on)
+            (isa bedroom-lamp lamp)
+            (state bedroom-lamp on)
+        ''')
+
+        self.assertTrue(kb.replace_atom(E(S('state'), S('kitchen-lamp'), S('on')),
+            E(S('state'), S('kitchen-lamp'), S('off'))))
+        self.assertFalse(kb.remove_atom(E(S('state'), S('hall-lamp'), S('on'))))
+        self.assertEqual(kb.remove_matching(E(S('isa'), V('x'), S('lamp'))), 2)
+
+        self.assertEqual(kb.get_content(), [
+            E(S('state'), S('bedroom-lamp'), S('on')),
+            E(S('state'), S('kitchen-lamp'), S('off'))])
+        self.assertEqual(kb.count(E(S('state'), V('x'), S('on'))), 1)
+
+    def test_match_statistics(self):
+        kb = self.atomese.parse('''
+            (isa kitchen-lamp lamp)
+            (isa bedroom-lamp lamp)
+            (isa Fred frog)
+        ''')
+
+        Stats.reset()
+        self.assertEqual(kb.count(E(S('isa'), V('x'), S('lamp'))), 2)
+        stats = Stats.snapshot()
+
+        self.assertEqual(stats['counters']['candidates_matched'], 2)
+        self.assertEqual(sum(stats['histograms']['match_latency']['buckets']), 1)
+        self.assertEqual(kb.get_stats()['candidates_matched'], 2)
+        self.assertEqual(kb.get_stats()['size'], 3)
+        self.assertIn('# TYPE hyperon_candidates_matched_total counter\n', Stats.prometheus())
+
     def test_match_variable_in_target(self):
         kb = self.atomese.parse('''
             (= (isa Fred frog) True)